@@ -0,0 +1,383 @@
+/** \file
+ *
+ * Contains a streaming parser for ANSI escape sequences, used to strip them from terminal output, and a display width
+ * calculator for the text that's left.
+ */
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <string_view>
+
+#if defined(__SSE2__) && (defined(__GNUC__) || defined(__clang__))
+#include <emmintrin.h>
+#define STC_ANSI_SSE2
+#endif
+
+/**
+ * \brief Module for dealing with ANSI escape sequences in existing text.
+ *
+ * \namespace stc::ansi
+ */
+namespace stc::ansi {
+
+namespace _detail {
+
+constexpr char ESC = '\033';
+constexpr char BEL = '\007';
+
+/**
+ * \returns the number of leading bytes that are printable ASCII (0x20-0x7E).
+ */
+inline size_t printableAsciiPrefix(const char* data, size_t size) {
+    size_t i = 0;
+#ifdef STC_ANSI_SSE2
+    // Signed comparisons: bytes >= 0x80 are negative, so they fail the > 0x1F check along with the control bytes
+    const __m128i low = _mm_set1_epi8(0x1F);
+    const __m128i high = _mm_set1_epi8(0x7F);
+    for (; i + 16 <= size; i += 16) {
+        __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+        __m128i printable = _mm_and_si128(_mm_cmpgt_epi8(chunk, low), _mm_cmplt_epi8(chunk, high));
+        auto mask = static_cast<unsigned int>(_mm_movemask_epi8(printable));
+        if (mask != 0xFFFF) {
+            return i + static_cast<size_t>(__builtin_ctz(~mask));
+        }
+    }
+#endif
+    for (; i < size; ++i) {
+        auto ch = static_cast<unsigned char>(data[i]);
+        if (ch < 0x20 || ch > 0x7E) {
+            break;
+        }
+    }
+    return i;
+}
+
+/**
+ * Approximation of wcwidth(3) for a single codepoint, that doesn't depend on the locale. Covers combining marks and
+ * zero-width characters (0), and the East Asian wide and emoji ranges (2). Everything else is 1.
+ */
+constexpr int codepointWidth(uint32_t cp) {
+    if (cp < 0x20 || (cp >= 0x7F && cp < 0xA0)) {
+        return 0;
+    }
+    if ((cp >= 0x0300 && cp <= 0x036F)
+        || (cp >= 0x1AB0 && cp <= 0x1AFF)
+        || (cp >= 0x1DC0 && cp <= 0x1DFF)
+        || (cp >= 0x200B && cp <= 0x200F)
+        || (cp >= 0x20D0 && cp <= 0x20FF)
+        || (cp >= 0xFE00 && cp <= 0xFE0F)
+        || (cp >= 0xFE20 && cp <= 0xFE2F)
+        || cp == 0xFEFF) {
+        return 0;
+    }
+    if ((cp >= 0x1100 && cp <= 0x115F)
+        || (cp >= 0x2E80 && cp <= 0xA4CF && cp != 0x303F)
+        || (cp >= 0xAC00 && cp <= 0xD7A3)
+        || (cp >= 0xF900 && cp <= 0xFAFF)
+        || (cp >= 0xFE30 && cp <= 0xFE4F)
+        || (cp >= 0xFF00 && cp <= 0xFF60)
+        || (cp >= 0xFFE0 && cp <= 0xFFE6)
+        || (cp >= 0x1F300 && cp <= 0x1F64F)
+        || (cp >= 0x1F900 && cp <= 0x1F9FF)
+        || (cp >= 0x20000 && cp <= 0x3FFFD)) {
+        return 2;
+    }
+    return 1;
+}
+
+}
+
+/**
+ * Streaming ANSI escape sequence stripper. Feed it chunks of terminal output in order, and it passes on the text
+ * between the escape sequences. Sequences split across chunks are handled, as the parser state is kept between calls.
+ *
+ * Handles CSI sequences (`ESC [ ... final`), OSC, DCS, SOS, PM, and APC strings (terminated by BEL or `ESC \`), and
+ * other two-byte and intermediate escape sequences. Other control characters, including newlines and tabs, are passed
+ * through as-is. 8-bit C1 controls are not treated as escapes, as they clash with UTF-8.
+ *
+ * Plain text runs are found with memchr, which is vectorised in every libc worth using, so text without escapes is
+ * passed on without being looked at byte-by-byte.
+ *
+ * Example use:
+ * ```cpp
+ * stc::ansi::AnsiStripper stripper;
+ * std::string out;
+ * for (auto& chunk : chunks) {
+ *     stripper.process(chunk, [&](std::string_view text) { out += text; });
+ * }
+ * ```
+ */
+class AnsiStripper {
+public:
+    enum class State : uint8_t {
+        GROUND,
+        /**
+         * After an ESC
+         */
+        ESCAPE,
+        /**
+         * After ESC followed by one or more intermediate bytes (0x20-0x2F)
+         */
+        ESCAPE_INTERMEDIATE,
+        CSI,
+        /**
+         * Inside an OSC, DCS, SOS, PM, or APC string
+         */
+        STRING,
+        /**
+         * After an ESC inside a string, which may be the start of the string terminator
+         */
+        STRING_ESCAPE,
+    };
+
+private:
+    State state = State::GROUND;
+
+public:
+    /**
+     * Processes a chunk, and calls `out` with each run of text that isn't part of an escape sequence. The views point
+     * into `chunk`, so no data is copied.
+     */
+    template <typename F>
+    void process(std::string_view chunk, F&& out) {
+        const char* data = chunk.data();
+        size_t size = chunk.size();
+        size_t i = 0;
+
+        while (i < size) {
+            if (state == State::GROUND) {
+                const void* found = std::memchr(data + i, _detail::ESC, size - i);
+                size_t end = found == nullptr ? size : static_cast<size_t>(static_cast<const char*>(found) - data);
+                if (end > i) {
+                    out(std::string_view(data + i, end - i));
+                }
+                if (found == nullptr) {
+                    return;
+                }
+                state = State::ESCAPE;
+                i = end + 1;
+                continue;
+            }
+
+            auto ch = static_cast<unsigned char>(data[i]);
+            switch (state) {
+            case State::ESCAPE:
+                if (ch == '[') {
+                    state = State::CSI;
+                } else if (ch == ']' || ch == 'P' || ch == 'X' || ch == '^' || ch == '_') {
+                    state = State::STRING;
+                } else if (ch >= 0x20 && ch <= 0x2F) {
+                    state = State::ESCAPE_INTERMEDIATE;
+                } else if (ch == static_cast<unsigned char>(_detail::ESC)) {
+                    // ESC ESC; the first one is dropped
+                } else {
+                    // Final byte of a two-byte sequence, or garbage. Either way, it's consumed
+                    state = State::GROUND;
+                }
+                break;
+            case State::ESCAPE_INTERMEDIATE:
+                if (ch == static_cast<unsigned char>(_detail::ESC)) {
+                    state = State::ESCAPE;
+                } else if (ch < 0x20 || ch > 0x2F) {
+                    state = State::GROUND;
+                }
+                break;
+            case State::CSI:
+                if (ch == static_cast<unsigned char>(_detail::ESC)) {
+                    // Aborts the sequence, and starts a new one
+                    state = State::ESCAPE;
+                } else if (ch >= 0x40 && ch <= 0x7E) {
+                    state = State::GROUND;
+                }
+                // Parameters, intermediates, and stray control bytes are all dropped
+                break;
+            case State::STRING: {
+                // Strings can be long (OSC 8 hyperlinks, for example), so skip to the next possible terminator
+                size_t end = i;
+                while (end < size && data[end] != _detail::ESC && data[end] != _detail::BEL) {
+                    ++end;
+                }
+                if (end == size) {
+                    return;
+                }
+                state = data[end] == _detail::BEL ? State::GROUND : State::STRING_ESCAPE;
+                i = end;
+            } break;
+            case State::STRING_ESCAPE:
+                if (ch == '\\') {
+                    state = State::GROUND;
+                } else if (ch == static_cast<unsigned char>(_detail::ESC)) {
+                    state = State::STRING_ESCAPE;
+                } else {
+                    // Not a terminator; the string was cut off by a new escape sequence
+                    state = State::ESCAPE;
+                    continue;
+                }
+                break;
+            case State::GROUND:
+                break;
+            }
+            ++i;
+        }
+    }
+
+    /**
+     * Processes a chunk, and appends the text to `out`.
+     */
+    void process(std::string_view chunk, std::string& out) {
+        process(chunk, [&](std::string_view text) { out.append(text); });
+    }
+
+    /**
+     * \returns whether or not the stripper is in the middle of an escape sequence.
+     */
+    bool isInSequence() const {
+        return state != State::GROUND;
+    }
+
+    State getState() const {
+        return state;
+    }
+
+    void reset() {
+        state = State::GROUND;
+    }
+};
+
+/**
+ * Streaming display width counter. Tracks the column a terminal's cursor would be on after printing the text, and
+ * the widest line seen. UTF-8 sequences split across chunks are handled.
+ *
+ * Escape sequences are NOT understood by this class; either feed it stripped text, or use visibleWidth().
+ *
+ * Widths are determined by _detail::codepointWidth, which is a locale-independent approximation of wcwidth. Tabs
+ * advance to the next multiple of 8, carriage returns go back to column 0, newlines start a new line, and other
+ * control characters take no space.
+ */
+class DisplayWidthCounter {
+private:
+    size_t column = 0;
+    size_t maxColumn = 0;
+
+    uint32_t codepoint = 0;
+    int remaining = 0;
+
+    void advance(size_t width) {
+        column += width;
+        if (column > maxColumn) {
+            maxColumn = column;
+        }
+    }
+
+public:
+    void add(std::string_view text) {
+        const char* data = text.data();
+        size_t size = text.size();
+        size_t i = 0;
+        while (i < size) {
+            if (remaining == 0) {
+                size_t ascii = _detail::printableAsciiPrefix(data + i, size - i);
+                if (ascii > 0) {
+                    advance(ascii);
+                    i += ascii;
+                    continue;
+                }
+            }
+
+            auto ch = static_cast<unsigned char>(data[i++]);
+            if (remaining > 0) {
+                if ((ch & 0xC0) == 0x80) {
+                    codepoint = (codepoint << 6) | (ch & 0x3F);
+                    if (--remaining == 0) {
+                        advance(static_cast<size_t>(_detail::codepointWidth(codepoint)));
+                    }
+                    continue;
+                }
+                // Truncated sequence; count it as a replacement character, and process this byte normally
+                remaining = 0;
+                advance(1);
+            }
+
+            if (ch < 0x80) {
+                if (ch == '\n') {
+                    column = 0;
+                } else if (ch == '\r') {
+                    column = 0;
+                } else if (ch == '\t') {
+                    advance(8 - column % 8);
+                }
+                // Other controls take no space
+            } else if ((ch & 0xE0) == 0xC0) {
+                codepoint = ch & 0x1F;
+                remaining = 1;
+            } else if ((ch & 0xF0) == 0xE0) {
+                codepoint = ch & 0x0F;
+                remaining = 2;
+            } else if ((ch & 0xF8) == 0xF0) {
+                codepoint = ch & 0x07;
+                remaining = 3;
+            } else {
+                // Invalid lead byte; terminals generally show a replacement character
+                advance(1);
+            }
+        }
+    }
+
+    /**
+     * \returns the current column
+     */
+    size_t getColumn() const {
+        return column;
+    }
+
+    /**
+     * \returns the widest line seen so far
+     */
+    size_t getWidth() const {
+        return maxColumn;
+    }
+
+    void reset() {
+        column = maxColumn = 0;
+        codepoint = 0;
+        remaining = 0;
+    }
+};
+
+/**
+ * \returns the text with all ANSI escape sequences removed.
+ * \see AnsiStripper
+ */
+inline std::string strip(std::string_view text) {
+    std::string out;
+    out.reserve(text.size());
+    AnsiStripper().process(text, out);
+    return out;
+}
+
+/**
+ * \returns the number of terminal columns the widest line of the text takes up. The text must not contain escape
+ *          sequences.
+ * \see DisplayWidthCounter
+ */
+inline size_t displayWidth(std::string_view text) {
+    DisplayWidthCounter counter;
+    counter.add(text);
+    return counter.getWidth();
+}
+
+/**
+ * Same as displayWidth, but ignores escape sequences, without allocating a stripped copy of the text.
+ */
+inline size_t visibleWidth(std::string_view text) {
+    DisplayWidthCounter counter;
+    AnsiStripper().process(text, [&](std::string_view run) { counter.add(run); });
+    return counter.getWidth();
+}
+
+}
+
+#undef STC_ANSI_SSE2
@@ -1,10 +1,24 @@
 /** \file */
 #pragma once
 
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <charconv>
+#include <cstddef>
 #include <cstdint>
 #include <ostream>
+#include <type_traits>
+#include <utility>
 #include "Environment.hpp"
 
+// The std::format integration is optional, as <format> is still missing from some standard libraries that otherwise
+// support everything else here (like libstdc++ before GCC 13)
+#if __has_include(<format>)
+#include <format>
+#define STC_COLOUR_FORMAT
+#endif
+
 /**
  * \brief Module for ANSI colours.
  *
@@ -24,6 +38,20 @@
  *
  * Like typography, 8 bit colours are hard-coded in stc::colour::FourBitColour.
  *
+ * If the colours aren't known at compile time (for example, if they come from a config file), use stc::colour::Style
+ * instead. It can be streamed like the manipulators, and doesn't allocate:
+ * ```cpp
+ * auto style = stc::colour::Style::of(stc::colour::foreground(config.accent), stc::colour::Typography::BOLD);
+ * std::cout << style << "Whatever" << stc::colour::reset << std::endl;
+ * ```
+ *
+ * ## Colour depth
+ *
+ * Not every terminal supports every kind of colour. The environment (`NO_COLOR`, `TERM`, and `COLORTERM`) is checked
+ * once per process, and colours the terminal doesn't support are converted to the nearest supported colour as they're
+ * written, so an 8 bit terminal never receives truecolour sequences. See stc::colour::ColourDepth and
+ * stc::colour::depth for details and overrides.
+ *
  * ## General usability note
  *
  * Though very outside the scope of this module, do be aware of the usability of the thing you make when you involve
@@ -100,59 +128,334 @@ enum class Typography {
     NO_BLINKING = 25
 };
 
+/**
+ * The colour capabilities of an output. Ordered, so depths can be compared to find out if one supports the colours of
+ * another.
+ */
+enum class ColourDepth : uint8_t {
+    /**
+     * No escape codes at all, including typography.
+     */
+    NONE = 0,
+    FOUR_BIT = 1,
+    EIGHT_BIT = 2,
+    TRUECOLOUR = 3,
+};
+
+/**
+ * Works out the colour depth supported by the terminal from the environment, without checking whether the output is a
+ * terminal in the first place. In order:
+ * 1. A non-empty `NO_COLOR` disables colour (https://no-color.org)
+ * 2. `TERM=dumb` disables colour
+ * 3. `COLORTERM=truecolor` or `COLORTERM=24bit`, a TERM ending in `-direct`, or Windows Terminal (`WT_SESSION`) means
+ *    truecolour
+ * 4. A TERM containing `256color` means 8 bit colour
+ * 5. Anything else is assumed to be 4 bit colour, which is supported by everything that isn't dumb
+ *
+ * \param getEnv    Function taking a `const char*` variable name, and returning a `const char*` value, or nullptr if
+ *                  the variable isn't set. std::getenv is used by getTerminalColourDepth; this is a parameter for
+ *                  testing purposes.
+ */
+template <typename F>
+constexpr ColourDepth detectColourDepth(F&& getEnv) {
+    auto read = [&](const char* name) -> std::string_view {
+        const char* value = getEnv(name);
+        return value == nullptr ? std::string_view {} : std::string_view { value };
+    };
+
+    if (!read("NO_COLOR").empty()) {
+        return ColourDepth::NONE;
+    }
+    auto term = read("TERM");
+    if (term == "dumb") {
+        return ColourDepth::NONE;
+    }
+    auto colourTerm = read("COLORTERM");
+    if (colourTerm == "truecolor" || colourTerm == "24bit" || term.ends_with("-direct")
+        || getEnv("WT_SESSION") != nullptr) {
+        return ColourDepth::TRUECOLOUR;
+    }
+    if (term.find("256color") != std::string_view::npos) {
+        return ColourDepth::EIGHT_BIT;
+    }
+    return ColourDepth::FOUR_BIT;
+}
+
+/**
+ * \returns detectColourDepth for the process environment. This is evaluated the first time it's called, and cached for
+ *          the rest of the process, so later changes to the environment are not picked up.
+ */
+inline ColourDepth getTerminalColourDepth() {
+    static const ColourDepth depth = detectColourDepth([](const char* name) -> const char* {
+#ifdef _MSC_VER
+#pragma warning(suppress : 4996)
+#endif
+        return std::getenv(name);
+    });
+    return depth;
+}
+
 namespace _detail {
 
 const int FOREGROUND = 38;
 const int BACKGROUND = 48;
 
+struct RGB {
+    uint8_t r, g, b;
+};
+
+/**
+ * The approximate RGB values of all 8 bit colours. The first 16 are the 4 bit colours, which are up to the terminal;
+ * these are xterm's defaults. The rest are the 6x6x6 colour cube, and a 24 step greyscale.
+ */
+inline constexpr auto eightBitPalette = []() {
+    std::array<RGB, 256> out {{
+        { 0, 0, 0 }, { 205, 0, 0 }, { 0, 205, 0 }, { 205, 205, 0 },
+        { 0, 0, 238 }, { 205, 0, 205 }, { 0, 205, 205 }, { 229, 229, 229 },
+        { 127, 127, 127 }, { 255, 0, 0 }, { 0, 255, 0 }, { 255, 255, 0 },
+        { 92, 92, 255 }, { 255, 0, 255 }, { 0, 255, 255 }, { 255, 255, 255 },
+    }};
+    constexpr uint8_t levels[] = { 0, 95, 135, 175, 215, 255 };
+    for (int i = 0; i < 216; ++i) {
+        out[16 + i] = { levels[i / 36], levels[(i / 6) % 6], levels[i % 6] };
+    }
+    for (int i = 0; i < 24; ++i) {
+        auto grey = static_cast<uint8_t>(8 + i * 10);
+        out[232 + i] = { grey, grey, grey };
+    }
+    return out;
+}();
+
+constexpr int colourDistance(RGB a, RGB b) {
+    int dr = a.r - b.r;
+    int dg = a.g - b.g;
+    int db = a.b - b.b;
+    return dr * dr + dg * dg + db * db;
+}
+
+/**
+ * Converts an index into eightBitPalette's first 16 colours to a foreground FourBitColour value.
+ */
+constexpr uint8_t paletteIndexToFourBit(int idx) {
+    return static_cast<uint8_t>(idx < 8 ? 30 + idx : 90 + idx - 8);
+}
+
+/**
+ * Nearest 4 bit colour (as a foreground FourBitColour value) for each 8 bit colour.
+ */
+inline constexpr auto eightBitToFourBit = []() {
+    std::array<uint8_t, 256> out {};
+    for (int i = 0; i < 256; ++i) {
+        int best = 0;
+        for (int j = 1; j < 16; ++j) {
+            if (colourDistance(eightBitPalette[i], eightBitPalette[j])
+                < colourDistance(eightBitPalette[i], eightBitPalette[best])) {
+                best = j;
+            }
+        }
+        out[i] = paletteIndexToFourBit(best);
+    }
+    return out;
+}();
+
+/**
+ * \returns the nearest 8 bit colour to an RGB colour. Only the colour cube and the greyscale are considered, as the
+ *          first 16 colours vary between terminals.
+ */
+constexpr uint8_t rgbToEightBit(uint8_t r, uint8_t g, uint8_t b) {
+    // Nearest cube level for each component. The levels are 0, 95, then steps of 40, so the midpoints are 48 and
+    // 115 + 40n
+    auto cubeLevel = [](int value) {
+        return value < 48 ? 0 : value < 115 ? 1 : (value - 35) / 40;
+    };
+    int cube = 16 + 36 * cubeLevel(r) + 6 * cubeLevel(g) + cubeLevel(b);
+
+    int average = (r + g + b) / 3;
+    int greyStep = average < 8 ? 0 : average > 238 ? 23 : (average - 3) / 10;
+    int grey = 232 + greyStep;
+
+    RGB target { r, g, b };
+    return static_cast<uint8_t>(
+        colourDistance(target, eightBitPalette[grey]) < colourDistance(target, eightBitPalette[cube]) ? grey : cube
+    );
+}
+
+constexpr uint8_t rgbToFourBit(uint8_t r, uint8_t g, uint8_t b) {
+    return eightBitToFourBit[rgbToEightBit(r, g, b)];
+}
+
 // forced: iword defaults to 0
 const int MODE_AUTO = 0;
 const int MODE_FORCE = 1;
 
 
+// Cached TTY state: iword defaults to 0
+const int TTY_UNKNOWN = 0;
+const int TTY_YES = 1;
+const int TTY_NO = 2;
+
+// Explicit depth: iword defaults to 0, which means automatic. Anything else is the ColourDepth + 1
+const int DEPTH_AUTO = 0;
+
 inline int getStreamConfigIdx() {
     static int idx = std::ios::xalloc();
     return idx;
 }
 
+inline int getStreamTTYIdx() {
+    static int idx = std::ios::xalloc();
+    return idx;
+}
+
+inline int getStreamDepthIdx() {
+    static int idx = std::ios::xalloc();
+    return idx;
+}
+
+/**
+ * Works out the colour depth to use for the stream:
+ * * Forced streams use the depth set with stc::colour::depth, or truecolour if none is set
+ * * Streams that aren't TTYs get no colour
+ * * TTYs use the depth set with stc::colour::depth, or getTerminalColourDepth() if none is set
+ *
+ * The TTY check is a syscall, so the result is cached in the stream the first time it's checked, and reused until
+ * stc::colour::refresh is used on the stream.
+ *
+ * Note that the first check on a given stream writes to the stream's iword storage. If several threads share a stream,
+ * make sure one of them prints something coloured (or uses stc::colour::refresh) before the others start.
+ */
+template <typename CharT>
+static ColourDepth getColourDepth(std::basic_ostream<CharT>& ss) {
+    auto explicitDepth = ss.iword(getStreamDepthIdx());
+    if (ss.iword(getStreamConfigIdx()) == MODE_FORCE) {
+        return explicitDepth == DEPTH_AUTO
+            ? ColourDepth::TRUECOLOUR
+            : static_cast<ColourDepth>(explicitDepth - 1);
+    }
+
+    auto& tty = ss.iword(getStreamTTYIdx());
+    if (tty == TTY_UNKNOWN) {
+        tty = isCppStreamTTY(ss) ? TTY_YES : TTY_NO;
+    }
+    if (tty != TTY_YES) {
+        return ColourDepth::NONE;
+    }
+    return explicitDepth == DEPTH_AUTO
+        ? getTerminalColourDepth()
+        : static_cast<ColourDepth>(explicitDepth - 1);
+}
+
+/**
+ * Checks whether any escape codes should be printed to the stream.
+ *
+ * \see getColourDepth
+ */
 template <typename CharT>
 static bool shouldPrintColour(std::basic_ostream<CharT>& ss) {
-    auto iword = ss.iword(getStreamConfigIdx());
-    if (iword == MODE_FORCE) {
-        return true;
+    return getColourDepth(ss) != ColourDepth::NONE;
+}
+
+/**
+ * SGR escape sequence (`\033[<params separated by ;>m`), generated at compile time. Every colour and typography code
+ * is a template parameter, so there's no reason to format them at runtime.
+ */
+template <typename CharT, int... Params>
+struct SGRSequence {
+    // \033, [, m, and at most three digits and a ; per parameter
+    static constexpr size_t capacity = 3 + sizeof...(Params) * 4;
+
+    std::array<CharT, capacity> data {};
+    size_t size = 0;
+
+    constexpr SGRSequence() {
+        static_assert(((Params >= 0 && Params <= 999) && ...), "SGR parameters must be between 0 and 999");
+        push('\033');
+        push('[');
+        bool first = true;
+        (pushParam(Params, first), ...);
+        push('m');
+    }
+
+private:
+    constexpr void push(char ch) {
+        data[size++] = static_cast<CharT>(ch);
     }
 
-    return isCppStreamTTY(ss);
+    constexpr void pushParam(int param, bool& first) {
+        if (!first) {
+            push(';');
+        }
+        first = false;
+        if (param >= 100) {
+            push(static_cast<char>('0' + param / 100));
+        }
+        if (param >= 10) {
+            push(static_cast<char>('0' + (param / 10) % 10));
+        }
+        push(static_cast<char>('0' + param % 10));
+    }
+};
+
+template <typename CharT, int... Params>
+inline constexpr SGRSequence<CharT, Params...> sgr {};
+
+/**
+ * Writes an SGR sequence with a single unformatted write, regardless of whether the stream should be coloured.
+ */
+template <typename CharT, int... Params>
+inline std::basic_ostream<CharT>& writeSGRUnchecked(std::basic_ostream<CharT>& stream) {
+    constexpr const auto& seq = sgr<CharT, Params...>;
+    stream.write(seq.data.data(), static_cast<std::streamsize>(seq.size));
+    return stream;
+}
+
+/**
+ * Writes an SGR sequence with a single unformatted write, if the stream should be coloured.
+ */
+template <typename CharT, int... Params>
+inline std::basic_ostream<CharT>& writeSGR(std::basic_ostream<CharT>& stream) {
+    if (shouldPrintColour(stream)) {
+        writeSGRUnchecked<CharT, Params...>(stream);
+    }
+    return stream;
 }
 
 template <int Mode>
 struct Colouriser {
+    /**
+     * SGR parameter for a foreground FourBitColour value
+     */
+    static constexpr int fourBitParam(int colour) {
+        return Mode == _detail::FOREGROUND ? colour : colour + 10;
+    }
+
     /**
      * \see stc::colour::FourBitColour
      * \see https://en.wikipedia.org/wiki/ANSI_escape_code#3-bit_and_4-bit
      */
     template <FourBitColour Colour, typename CharT>
     static constexpr std::basic_ostream<CharT>& fourBit(std::basic_ostream<CharT>& stream) {
-        if (shouldPrintColour(stream)) {
-            stream << "\033["
-                << (Mode == _detail::FOREGROUND ? static_cast<int>(Colour) : (static_cast<int>(Colour) + 10))
-                << "m";
-        }
-        return stream;
+        return writeSGR<CharT, fourBitParam(static_cast<int>(Colour))>(stream);
     }
 
     /**
      * Note that unlike four bit colours, 8 bit colours use a full uint8_t (from 0 to 255), so the values themselves are
      * not named in an enum.
      *
+     * On terminals that only support 4 bit colour, the nearest 4 bit colour is used instead.
+     *
      * \see https://en.wikipedia.org/wiki/ANSI_escape_code#8-bit
      */
     template <uint8_t code, typename CharT>
     static constexpr std::basic_ostream<CharT>& eightBit(std::basic_ostream<CharT>& stream) {
-        if (shouldPrintColour(stream)) {
-            stream << "\033[" << Mode << ";5;" << code << "m";
+        switch (getColourDepth(stream)) {
+        case ColourDepth::NONE:
+            return stream;
+        case ColourDepth::FOUR_BIT:
+            return writeSGRUnchecked<CharT, fourBitParam(eightBitToFourBit[code])>(stream);
+        default:
+            return writeSGRUnchecked<CharT, Mode, 5, code>(stream);
         }
-        return stream;
     }
 
     /**
@@ -163,14 +466,23 @@ struct Colouriser {
      * visibly everywhere. Remember that some people use light mode or theme variants that may not work with the colour
      * you've picked. You need to be extra aware of theming when using this function.
      *
+     * On terminals that don't support truecolour, the nearest 8 or 4 bit colour is used instead. The conversion is done
+     * at compile time.
+     *
      * \see https://en.wikipedia.org/wiki/ANSI_escape_code#24-bit
      */
     template <uint8_t r, uint8_t g, uint8_t b, typename CharT>
     static constexpr std::basic_ostream<CharT>& truecolour(std::basic_ostream<CharT>& stream) {
-        if (shouldPrintColour(stream)) {
-            stream << "\033[" << Mode << ";2;" << r << ";" << g << ";" << b << "m";
+        switch (getColourDepth(stream)) {
+        case ColourDepth::NONE:
+            return stream;
+        case ColourDepth::FOUR_BIT:
+            return writeSGRUnchecked<CharT, fourBitParam(rgbToFourBit(r, g, b))>(stream);
+        case ColourDepth::EIGHT_BIT:
+            return writeSGRUnchecked<CharT, Mode, 5, rgbToEightBit(r, g, b)>(stream);
+        default:
+            return writeSGRUnchecked<CharT, Mode, 2, r, g, b>(stream);
         }
-        return stream;
     }
 };
 
@@ -185,10 +497,7 @@ using BgColour = _detail::Colouriser<_detail::BACKGROUND>;
  */
 template <Typography feature, typename CharT>
 static constexpr std::basic_ostream<CharT>& use(std::basic_ostream<CharT>& stream) {
-    if (_detail::shouldPrintColour(stream)) {
-        stream << "\033[" << static_cast<int>(feature) << "m";
-    }
-    return stream;
+    return _detail::writeSGR<CharT, static_cast<int>(feature)>(stream);
 }
 
 /**
@@ -209,15 +518,54 @@ static constexpr std::basic_ostream<CharT>& force(std::basic_ostream<CharT>& str
     return stream;
 }
 
+/**
+ * Overrides the colour depth for the stream. By default, the depth is detected from the environment with
+ * getTerminalColourDepth, or truecolour if the stream is forced. Colours the depth doesn't support are converted to the
+ * nearest supported colour when they're written.
+ *
+ * This doesn't enable colour on streams that aren't TTYs; combine it with stc::colour::force for that:
+ * ```cpp
+ * ss << stc::colour::force << stc::colour::depth<stc::colour::ColourDepth::EIGHT_BIT>;
+ * ```
+ *
+ * Use stc::colour::autoDepth to go back to automatic detection.
+ */
+template <ColourDepth value, typename CharT>
+static constexpr std::basic_ostream<CharT>& depth(std::basic_ostream<CharT>& stream) {
+    stream.iword(_detail::getStreamDepthIdx()) = static_cast<long>(value) + 1;
+    return stream;
+}
+
+/**
+ * Undoes stc::colour::depth.
+ */
+template <typename CharT>
+static constexpr std::basic_ostream<CharT>& autoDepth(std::basic_ostream<CharT>& stream) {
+    stream.iword(_detail::getStreamDepthIdx()) = _detail::DEPTH_AUTO;
+    return stream;
+}
+
+/**
+ * Redoes the TTY check for the stream. Whether or not a stream is a TTY is only checked once per stream, and cached
+ * afterwards. If the underlying fd is redirected at runtime (for example with dup2), use this to pick up the change:
+ * ```cpp
+ * std::cout << stc::colour::refresh;
+ * ```
+ *
+ * This does not affect forcing; see stc::colour::force.
+ */
+template <typename CharT>
+static constexpr std::basic_ostream<CharT>& refresh(std::basic_ostream<CharT>& stream) {
+    stream.iword(_detail::getStreamTTYIdx()) = isCppStreamTTY(stream) ? _detail::TTY_YES : _detail::TTY_NO;
+    return stream;
+}
+
 /**
  * Prints the reset ANSI code, clearing all active effects.
  */
 template <typename CharT>
 static constexpr std::basic_ostream<CharT>& reset(std::basic_ostream<CharT>& stream) {
-    if (_detail::shouldPrintColour(stream)) {
-        stream << "\033[0m";
-    }
-    return stream;
+    return _detail::writeSGR<CharT, 0>(stream);
 }
 
 /**
@@ -281,4 +629,462 @@ static constexpr std::basic_ostream<CharT>& bg(std::basic_ostream<CharT>& stream
 }
 
 
+/**
+ * Runtime representation of a single colour, in any of the supported colour modes. Mainly used through Style and
+ * styled(); the stream manipulators take the colour as template parameters instead.
+ */
+struct Colour {
+    enum class Type : uint8_t {
+        /**
+         * No colour; the terminal's default is used.
+         */
+        DEFAULT,
+        FOUR_BIT,
+        EIGHT_BIT,
+        TRUECOLOUR,
+    };
+
+    Type type = Type::DEFAULT;
+    /**
+     * For FOUR_BIT, r is the FourBitColour (as a foreground colour). For EIGHT_BIT, r is the colour code. For
+     * TRUECOLOUR, all three are used as you'd expect.
+     */
+    uint8_t r = 0, g = 0, b = 0;
+
+    static constexpr Colour fourBit(FourBitColour colour) {
+        return { Type::FOUR_BIT, static_cast<uint8_t>(colour), 0, 0 };
+    }
+    static constexpr Colour eightBit(uint8_t code) {
+        return { Type::EIGHT_BIT, code, 0, 0 };
+    }
+    static constexpr Colour rgb(uint8_t r, uint8_t g, uint8_t b) {
+        return { Type::TRUECOLOUR, r, g, b };
+    }
+
+    /**
+     * \returns the nearest colour that can be shown with the given depth. Colours that are already supported are
+     *          returned as-is, and so is everything if the depth is NONE, as there's nothing sensible to convert to.
+     */
+    constexpr Colour downgrade(ColourDepth depth) const {
+        if (depth == ColourDepth::FOUR_BIT) {
+            if (type == Type::EIGHT_BIT) {
+                return { Type::FOUR_BIT, _detail::eightBitToFourBit[r], 0, 0 };
+            } else if (type == Type::TRUECOLOUR) {
+                return { Type::FOUR_BIT, _detail::rgbToFourBit(r, g, b), 0, 0 };
+            }
+        } else if (depth == ColourDepth::EIGHT_BIT && type == Type::TRUECOLOUR) {
+            return eightBit(_detail::rgbToEightBit(r, g, b));
+        }
+        return *this;
+    }
+
+    constexpr bool operator==(const Colour&) const = default;
+};
+
+struct Foreground {
+    Colour colour;
+};
+struct Background {
+    Colour colour;
+};
+
+constexpr Foreground foreground(FourBitColour colour) { return { Colour::fourBit(colour) }; }
+constexpr Foreground foreground(uint8_t code) { return { Colour::eightBit(code) }; }
+constexpr Foreground foreground(uint8_t r, uint8_t g, uint8_t b) { return { Colour::rgb(r, g, b) }; }
+constexpr Background background(FourBitColour colour) { return { Colour::fourBit(colour) }; }
+constexpr Background background(uint8_t code) { return { Colour::eightBit(code) }; }
+constexpr Background background(uint8_t r, uint8_t g, uint8_t b) { return { Colour::rgb(r, g, b) }; }
+
+namespace _detail {
+
+/**
+ * Short, fixed-size string used for the precomputed escape tables.
+ */
+template <size_t N>
+struct FixedString {
+    std::array<char, N> data {};
+    uint8_t size = 0;
+
+    constexpr void append(std::string_view str) {
+        for (char ch : str) {
+            data[size++] = ch;
+        }
+    }
+    constexpr void appendInt(int value) {
+        if (value >= 100) {
+            data[size++] = static_cast<char>('0' + value / 100);
+        }
+        if (value >= 10) {
+            data[size++] = static_cast<char>('0' + (value / 10) % 10);
+        }
+        data[size++] = static_cast<char>('0' + value % 10);
+    }
+    constexpr std::string_view view() const {
+        return { data.data(), size };
+    }
+};
+
+/**
+ * Decimal representations of 0-255, used for typography and 4 bit colour parameters.
+ */
+inline constexpr auto decimalTable = []() {
+    std::array<FixedString<3>, 256> out {};
+    for (int i = 0; i < 256; ++i) {
+        out[i].appendInt(i);
+    }
+    return out;
+}();
+
+/**
+ * Full parameters for 8 bit colours, i.e. `38;5;n` and `48;5;n`, indexed by the colour code.
+ */
+template <int Mode>
+inline constexpr auto eightBitTable = []() {
+    std::array<FixedString<8>, 256> out {};
+    for (int i = 0; i < 256; ++i) {
+        out[i].appendInt(Mode);
+        out[i].append(";5;");
+        out[i].appendInt(i);
+    }
+    return out;
+}();
+
+}
+
+/**
+ * Rendered SGR sequence, stored inline so rendering a Style never allocates. Large enough for every typography
+ * feature, and a truecolour foreground and background.
+ */
+struct SGRBuffer {
+    // Deliberately left uninitialised; only the first `size` bytes are ever read
+    std::array<char, 128> data;
+    size_t size = 0;
+
+    std::string_view view() const {
+        return { data.data(), size };
+    }
+
+    void append(std::string_view str) {
+        std::copy(str.begin(), str.end(), data.data() + size);
+        size += str.size();
+    }
+
+    void append(char ch) {
+        data[size++] = ch;
+    }
+};
+
+/**
+ * Runtime combination of a foreground colour, a background colour, and any number of Typography features. Unlike the
+ * stream manipulators, this writes a single SGR sequence containing everything.
+ *
+ * Example use:
+ * ```cpp
+ * auto style = stc::colour::Style::of(
+ *     stc::colour::foreground(stc::colour::FourBitColour::RED),
+ *     stc::colour::Typography::BOLD
+ * );
+ * ```
+ */
+struct Style {
+    Colour fg;
+    Colour bg;
+    /**
+     * Bitmask of Typography features, where bit N corresponds to the Typography with the value N.
+     */
+    uint32_t typography = 0;
+
+    constexpr Style& add(Foreground part) {
+        fg = part.colour;
+        return *this;
+    }
+    constexpr Style& add(Background part) {
+        bg = part.colour;
+        return *this;
+    }
+    constexpr Style& add(Typography part) {
+        typography |= uint32_t(1) << static_cast<int>(part);
+        return *this;
+    }
+
+    template <typename... Parts>
+    static constexpr Style of(Parts... parts) {
+        Style style;
+        (style.add(parts), ...);
+        return style;
+    }
+
+    constexpr bool has(Typography feature) const {
+        return (typography & (uint32_t(1) << static_cast<int>(feature))) != 0;
+    }
+
+    constexpr bool empty() const {
+        return fg.type == Colour::Type::DEFAULT && bg.type == Colour::Type::DEFAULT && typography == 0;
+    }
+
+    constexpr bool operator==(const Style&) const = default;
+
+    /**
+     * \returns the style with both colours downgraded to the given depth.
+     * \see Colour::downgrade
+     */
+    constexpr Style downgrade(ColourDepth depth) const {
+        return { fg.downgrade(depth), bg.downgrade(depth), typography };
+    }
+
+    /**
+     * Calls param(int) once for each SGR parameter needed for a colour, in order.
+     *
+     * \param mode _detail::FOREGROUND or _detail::BACKGROUND
+     */
+    template <typename F>
+    static constexpr void forEachColourParam(const Colour& colour, int mode, F&& param) {
+        switch (colour.type) {
+        case Colour::Type::DEFAULT:
+            break;
+        case Colour::Type::FOUR_BIT:
+            param(mode == _detail::FOREGROUND ? colour.r : colour.r + 10);
+            break;
+        case Colour::Type::EIGHT_BIT:
+            param(mode);
+            param(5);
+            param(colour.r);
+            break;
+        case Colour::Type::TRUECOLOUR:
+            param(mode);
+            param(2);
+            param(colour.r);
+            param(colour.g);
+            param(colour.b);
+            break;
+        }
+    }
+
+    /**
+     * Calls param(int) once for each SGR parameter in the style; typography first, then the foreground, then the
+     * background.
+     */
+    template <typename F>
+    constexpr void forEachParam(F&& param) const {
+        for (int i = 0; i < 32; ++i) {
+            if ((typography & (uint32_t(1) << i)) != 0) {
+                param(i);
+            }
+        }
+        forEachColourParam(fg, _detail::FOREGROUND, param);
+        forEachColourParam(bg, _detail::BACKGROUND, param);
+    }
+
+    /**
+     * Writes a single SGR parameter, without separators.
+     */
+    template <typename OutputIt>
+    static constexpr OutputIt writeParam(OutputIt out, int value) {
+        if (value >= 100) {
+            *out++ = static_cast<char>('0' + value / 100);
+        }
+        if (value >= 10) {
+            *out++ = static_cast<char>('0' + (value / 10) % 10);
+        }
+        *out++ = static_cast<char>('0' + value % 10);
+        return out;
+    }
+
+    /**
+     * Renders the style as a single SGR sequence, without allocating. The sequence is empty if the style is empty.
+     *
+     * 4 and 8 bit colours, as well as typography, are looked up in precomputed tables, so only truecolour needs any
+     * actual number formatting.
+     *
+     * \param depth   The colour depth of the output. Colours are downgraded to fit, and nothing is rendered for NONE.
+     */
+    SGRBuffer render(ColourDepth depth = ColourDepth::TRUECOLOUR) const {
+        SGRBuffer out;
+        if (empty() || depth == ColourDepth::NONE) {
+            return out;
+        }
+        if (depth != ColourDepth::TRUECOLOUR) {
+            return downgrade(depth).render();
+        }
+        out.append("\033[");
+        bool first = true;
+        auto separate = [&]() {
+            if (!first) {
+                out.append(';');
+            }
+            first = false;
+        };
+
+        // Only the bits that correspond to actual Typography values can be set through add(), but typography is a
+        // public field, so anything goes
+        for (uint32_t bits = typography; bits != 0; bits &= bits - 1) {
+            separate();
+            out.append(_detail::decimalTable[std::countr_zero(bits)].view());
+        }
+
+        auto colour = [&]<int Mode>(const Colour& value) {
+            switch (value.type) {
+            case Colour::Type::DEFAULT:
+                return;
+            case Colour::Type::FOUR_BIT:
+                separate();
+                out.append(_detail::decimalTable[Mode == _detail::FOREGROUND ? value.r : value.r + 10].view());
+                return;
+            case Colour::Type::EIGHT_BIT:
+                separate();
+                out.append(_detail::eightBitTable<Mode>[value.r].view());
+                return;
+            case Colour::Type::TRUECOLOUR: {
+                separate();
+                out.append(_detail::decimalTable[Mode].view());
+                out.append(";2");
+                char* end = out.data.data() + out.data.size();
+                for (auto component : { value.r, value.g, value.b }) {
+                    out.append(';');
+                    auto res = std::to_chars(out.data.data() + out.size, end, component);
+                    out.size = static_cast<size_t>(res.ptr - out.data.data());
+                }
+                return;
+            }
+            }
+        };
+        colour.template operator()<_detail::FOREGROUND>(fg);
+        colour.template operator()<_detail::BACKGROUND>(bg);
+        out.append('m');
+        return out;
+    }
+
+    /**
+     * Writes the style as a single SGR sequence. Writes nothing if the style is empty.
+     */
+    template <typename OutputIt>
+    OutputIt write(OutputIt out, ColourDepth depth = ColourDepth::TRUECOLOUR) const {
+        auto rendered = render(depth);
+        return std::copy(rendered.data.data(), rendered.data.data() + rendered.size, out);
+    }
+
+    /**
+     * Writes the reset sequence.
+     */
+    template <typename OutputIt>
+    static constexpr OutputIt writeReset(OutputIt out) {
+        for (char ch : std::string_view("\033[0m")) {
+            *out++ = ch;
+        }
+        return out;
+    }
+};
+
+/**
+ * Wrapper around a value that adds a style when formatted with std::format. Created with styled() or
+ * OutputTarget::styled(). If the value is an lvalue, it's stored by reference, so the Styled object should be used
+ * right away, like std::format's own arguments.
+ *
+ * The std::formatter specialisation is only defined if <format> is available.
+ */
+template <typename T>
+struct Styled {
+    T value;
+    Style style;
+    bool enabled;
+};
+
+/**
+ * Wraps a value with a style, to be used with std::format:
+ * ```cpp
+ * std::format("{:>5}", stc::colour::styled(42, stc::colour::foreground(240), stc::colour::Typography::BOLD));
+ * ```
+ * The format spec applies to the value itself, so padding doesn't count the escape codes.
+ *
+ * Unlike the stream manipulators, this always writes the escape codes, as there's no stream to check. Use
+ * OutputTarget::styled() to only write them when the output supports them.
+ */
+template <typename T, typename... Parts>
+constexpr Styled<T> styled(T&& value, Parts... parts) {
+    return { std::forward<T>(value), Style::of(parts...), true };
 }
+
+/**
+ * Colour decision for an output target, resolved once. Checking whether a stream is a TTY is comparatively expensive,
+ * and a format context doesn't know where its output ends up anyway, so code that formats a lot of styled output
+ * should resolve the target once, and style values through it.
+ *
+ * Example use:
+ * ```cpp
+ * auto target = stc::colour::OutputTarget::of(std::cout);
+ * std::string line;
+ * std::format_to(
+ *     std::back_inserter(line),
+ *     "{} | {}\n",
+ *     target.styled("error", stc::colour::foreground(stc::colour::FourBitColour::RED)),
+ *     message
+ * );
+ * ```
+ */
+struct OutputTarget {
+    bool enabled;
+    /**
+     * Colours are downgraded to this depth when styling values.
+     */
+    ColourDepth depth = ColourDepth::TRUECOLOUR;
+
+    /**
+     * Resolves the target with the same TTY, force, and depth semantics as the stream manipulators.
+     */
+    template <typename CharT>
+    static OutputTarget of(std::basic_ostream<CharT>& stream) {
+        auto depth = _detail::getColourDepth(stream);
+        return { depth != ColourDepth::NONE, depth };
+    }
+
+    template <typename T, typename... Parts>
+    constexpr Styled<T> styled(T&& value, Parts... parts) const {
+        return { std::forward<T>(value), Style::of(parts...).downgrade(depth), enabled };
+    }
+};
+
+/**
+ * Writes a runtime Style to a stream, with the same TTY, force, and depth semantics as the stream manipulators. The
+ * whole sequence is written with a single stream.write, and nothing is allocated.
+ *
+ * Example use:
+ * ```cpp
+ * auto style = stc::colour::Style::of(stc::colour::foreground(config.errorColour));
+ * std::cout << style << "Error" << stc::colour::reset << std::endl;
+ * ```
+ */
+template <typename CharT>
+inline std::basic_ostream<CharT>& operator<<(std::basic_ostream<CharT>& stream, const Style& style) {
+    if (style.empty()) {
+        return stream;
+    }
+    auto rendered = style.render(_detail::getColourDepth(stream));
+    if constexpr (std::is_same_v<CharT, char>) {
+        stream.write(rendered.data.data(), static_cast<std::streamsize>(rendered.size));
+    } else {
+        std::array<CharT, sizeof(rendered.data)> widened;
+        std::copy(rendered.data.data(), rendered.data.data() + rendered.size, widened.data());
+        stream.write(widened.data(), static_cast<std::streamsize>(rendered.size));
+    }
+    return stream;
+}
+
+}
+
+#ifdef STC_COLOUR_FORMAT
+template <typename T, typename CharT>
+struct std::formatter<stc::colour::Styled<T>, CharT> : std::formatter<std::remove_cvref_t<T>, CharT> {
+    template <typename FormatContext>
+    auto format(const stc::colour::Styled<T>& styled, FormatContext& ctx) const {
+        bool colour = styled.enabled && !styled.style.empty();
+        if (colour) {
+            ctx.advance_to(styled.style.write(ctx.out()));
+        }
+        auto out = std::formatter<std::remove_cvref_t<T>, CharT>::format(styled.value, ctx);
+        if (colour) {
+            out = stc::colour::Style::writeReset(out);
+        }
+        return out;
+    }
+};
+#endif
@@ -0,0 +1,418 @@
+/** \file
+ *
+ * Contains a read-optimised, thread-safe view of the environment. See stc::EnvSnapshot.
+ */
+#pragma once
+
+#include <atomic>
+#include <charconv>
+#include <cstdint>
+#include <cstdlib>
+#include <forward_list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#ifdef _WIN32
+#define STC_ENVIRON _environ
+#else
+#include <unistd.h>
+extern char** environ;
+#define STC_ENVIRON environ
+#endif
+
+namespace stc {
+
+/**
+ * Indexed, immutable-once-published copy of the environment.
+ *
+ * std::getenv and friends do a linear scan over `environ` on every call, and stc::getEnv copies the result into a new
+ * string on top of that. Modifying the environment with setenv while other threads read it is also undefined
+ * behaviour. EnvSnapshot copies the environment once into a single arena, and indexes it in a hash map. Reads are
+ * lock-free, and never allocate, aside the first typed lookup of a variable.
+ *
+ * Updates are copy-on-write: set(), unset(), update(), and reload() build an entirely new index, and atomically swap
+ * it in. Readers that started before the swap finish on the old index, so they never see a partially updated
+ * environment. Updates are serialised with a mutex, so they should be rare compared to reads.
+ *
+ * Old indexes are kept alive until the EnvSnapshot itself is destroyed. This means every string_view returned by an
+ * EnvSnapshot stays valid for the lifetime of the EnvSnapshot, regardless of later updates, but it also means that
+ * each update permanently costs the size of the environment in memory. If you update it in a loop, you're gonna have
+ * a bad time.
+ *
+ * Each call on the EnvSnapshot itself reads whatever index is current at the time, so two calls can see different
+ * versions of the environment if an update happens in between. If several variables need to be consistent with each
+ * other, read them through a single view().
+ *
+ * Note that updates only affect the snapshot, and are NOT written back to the process' environment. Use stc::setEnv
+ * followed by reload() if child processes need to see the change.
+ *
+ * Example use:
+ * ```cpp
+ * auto& env = stc::EnvSnapshot::getInstance();
+ * int64_t threads = env.getInt("THREADS").value_or(4);
+ * for (auto& dir : env.getList("PATH")) {
+ *     // ...
+ * }
+ * ```
+ */
+class EnvSnapshot {
+private:
+    struct Entry {
+        enum class CacheState : uint8_t {
+            EMPTY,
+            WRITING,
+            READY,
+        };
+
+        std::string_view value;
+
+        // Typed caches. Each cache is written by whichever thread gets to move it from EMPTY to WRITING, and can be
+        // read by anyone once it's READY. Threads that lose the race just parse the value themselves.
+        mutable std::atomic<CacheState> intState = CacheState::EMPTY;
+        mutable std::optional<int64_t> intValue;
+        mutable std::atomic<CacheState> boolState = CacheState::EMPTY;
+        mutable std::optional<bool> boolValue;
+        mutable std::atomic<CacheState> listState = CacheState::EMPTY;
+        mutable std::vector<std::string_view> listValue;
+        // Lists are returned as spans, so threads that lose the race for listValue need somewhere else to keep their
+        // result alive. This only happens when several threads look up the same list for the first time at once.
+        mutable std::mutex spillLock;
+        mutable std::forward_list<std::vector<std::string_view>> listSpill;
+
+        Entry(std::string_view value) : value(value) {}
+    };
+
+    struct State {
+        std::string arena;
+        std::unordered_map<std::string_view, Entry> entries;
+
+        /**
+         * Builds a state from a list of key-value pairs. The views don't need to outlive the state, as everything is
+         * copied into the arena.
+         */
+        State(const std::vector<std::pair<std::string_view, std::string_view>>& pairs) {
+            size_t size = 0;
+            for (const auto& [key, value] : pairs) {
+                size += key.size() + value.size();
+            }
+            // The arena must never reallocate, or every view into it dies
+            arena.reserve(size);
+            entries.reserve(pairs.size());
+
+            for (const auto& [key, value] : pairs) {
+                size_t offset = arena.size();
+                arena.append(key);
+                arena.append(value);
+                std::string_view view(arena);
+                // Duplicate keys are technically legal in environ. getenv uses the first one, so this does too.
+                entries.try_emplace(
+                    view.substr(offset, key.size()),
+                    view.substr(offset + key.size(), value.size())
+                );
+            }
+        }
+    };
+
+    std::atomic<const State*> current;
+
+    std::mutex writeLock;
+    std::vector<std::unique_ptr<State>> states;
+
+    static std::vector<std::pair<std::string_view, std::string_view>> readEnviron() {
+        std::vector<std::pair<std::string_view, std::string_view>> out;
+        for (char** env = STC_ENVIRON; env != nullptr && *env != nullptr; ++env) {
+            std::string_view line(*env);
+            auto sep = line.find('=');
+            if (sep == std::string_view::npos) {
+                continue;
+            }
+            out.emplace_back(line.substr(0, sep), line.substr(sep + 1));
+        }
+        return out;
+    }
+
+    /**
+     * Publishes a new state. The caller must hold writeLock.
+     */
+    void publish(std::unique_ptr<State> state) {
+        current.store(state.get(), std::memory_order_release);
+        states.push_back(std::move(state));
+    }
+
+    static const Entry* find(const State* state, std::string_view name) {
+        auto it = state->entries.find(name);
+        if (it == state->entries.end()) {
+            return nullptr;
+        }
+        return &it->second;
+    }
+
+    /**
+     * Returns the cached value if it's ready, or parses it and tries to cache it otherwise.
+     */
+    template <typename T, typename Parser>
+    static T cached(std::atomic<Entry::CacheState>& state, T& value, std::string_view raw, Parser parser) {
+        if (state.load(std::memory_order_acquire) == Entry::CacheState::READY) {
+            return value;
+        }
+        T parsed = parser(raw);
+        auto expected = Entry::CacheState::EMPTY;
+        if (state.compare_exchange_strong(expected, Entry::CacheState::WRITING, std::memory_order_acquire)) {
+            value = parsed;
+            state.store(Entry::CacheState::READY, std::memory_order_release);
+        }
+        return parsed;
+    }
+
+public:
+    /**
+     * Read-only view of a single version of the environment. Everything read through the same view comes from the
+     * same version, regardless of updates made in the meanwhile. Views are cheap to copy, and are obtained through
+     * EnvSnapshot::view().
+     */
+    class View {
+    private:
+        const State* state;
+
+        friend class EnvSnapshot;
+        View(const State* state) : state(state) {}
+
+    public:
+        /**
+         * \returns the value of the variable, or std::nullopt if it isn't set. The view stays valid for the lifetime
+         *          of the EnvSnapshot.
+         */
+        std::optional<std::string_view> get(std::string_view name) const {
+            if (const auto* entry = find(state, name); entry != nullptr) {
+                return entry->value;
+            }
+            return std::nullopt;
+        }
+
+        /**
+         * \returns the value of the variable, or the fallback if it isn't set.
+         */
+        std::string_view get(std::string_view name, std::string_view fallback) const {
+            return get(name).value_or(fallback);
+        }
+
+        bool contains(std::string_view name) const {
+            return find(state, name) != nullptr;
+        }
+
+        /**
+         * \returns the variable parsed as a base 10 integer, or std::nullopt if the variable isn't set or isn't
+         *          entirely made up of an integer.
+         */
+        std::optional<int64_t> getInt(std::string_view name) const {
+            const auto* entry = find(state, name);
+            if (entry == nullptr) {
+                return std::nullopt;
+            }
+            return cached(entry->intState, entry->intValue, entry->value, [](std::string_view raw) {
+                int64_t out = 0;
+                auto [end, err] = std::from_chars(raw.data(), raw.data() + raw.size(), out);
+                if (err != std::errc {} || end != raw.data() + raw.size()) {
+                    return std::optional<int64_t> {};
+                }
+                return std::optional<int64_t> { out };
+            });
+        }
+
+        /**
+         * \returns the variable parsed as a bool, or std::nullopt if the variable isn't set or isn't a recognised
+         *          value. `1`, `true`, `yes`, and `on` are true, while `0`, `false`, `no`, `off`, and the empty string
+         *          are false. The comparison is case-insensitive.
+         */
+        std::optional<bool> getBool(std::string_view name) const {
+            const auto* entry = find(state, name);
+            if (entry == nullptr) {
+                return std::nullopt;
+            }
+            return cached(entry->boolState, entry->boolValue, entry->value, [](std::string_view raw) {
+                std::string lower(raw.size(), '\0');
+                for (size_t i = 0; i < raw.size(); ++i) {
+                    lower[i] = raw[i] >= 'A' && raw[i] <= 'Z' ? static_cast<char>(raw[i] + 32) : raw[i];
+                }
+                if (lower == "1" || lower == "true" || lower == "yes" || lower == "on") {
+                    return std::optional<bool> { true };
+                }
+                if (lower.empty() || lower == "0" || lower == "false" || lower == "no" || lower == "off") {
+                    return std::optional<bool> { false };
+                }
+                return std::optional<bool> {};
+            });
+        }
+
+        /**
+         * \returns the variable split by `:`, like PATH. Empty elements are kept, as they're meaningful in some
+         *          variables (an empty element in PATH means the current directory). An unset variable returns an
+         *          empty list, and a set but empty variable returns a list with one empty element. The span stays
+         *          valid for the lifetime of the EnvSnapshot.
+         */
+        std::span<const std::string_view> getList(std::string_view name) const {
+            const auto* entry = find(state, name);
+            if (entry == nullptr) {
+                return {};
+            }
+            if (entry->listState.load(std::memory_order_acquire) == Entry::CacheState::READY) {
+                return entry->listValue;
+            }
+
+            std::vector<std::string_view> parsed;
+            std::string_view raw = entry->value;
+            size_t start = 0;
+            size_t end;
+            while ((end = raw.find(':', start)) != std::string_view::npos) {
+                parsed.push_back(raw.substr(start, end - start));
+                start = end + 1;
+            }
+            parsed.push_back(raw.substr(start));
+
+            auto expected = Entry::CacheState::EMPTY;
+            if (entry->listState.compare_exchange_strong(
+                expected, Entry::CacheState::WRITING, std::memory_order_acquire
+            )) {
+                entry->listValue = std::move(parsed);
+                entry->listState.store(Entry::CacheState::READY, std::memory_order_release);
+                return entry->listValue;
+            }
+            // Lost the race, and the winner may not be done writing yet
+            std::lock_guard l(entry->spillLock);
+            return entry->listSpill.emplace_front(std::move(parsed));
+        }
+
+        /**
+         * \returns the number of variables in the view.
+         */
+        size_t size() const {
+            return state->entries.size();
+        }
+    };
+
+    /**
+     * Creates a snapshot of the current environment.
+     *
+     * This reads `environ`, and must therefore not race with setenv or friends.
+     */
+    EnvSnapshot() {
+        publish(std::make_unique<State>(readEnviron()));
+    }
+
+    EnvSnapshot(const EnvSnapshot&) = delete;
+    EnvSnapshot& operator=(const EnvSnapshot&) = delete;
+
+    /**
+     * \returns a view of the current version of the environment. Updates made after this call are not visible through
+     *          the view. Like everything else returned by the EnvSnapshot, it stays valid for the lifetime of the
+     *          EnvSnapshot.
+     */
+    View view() const {
+        return View(current.load(std::memory_order_acquire));
+    }
+
+    /**
+     * \see View::get(std::string_view) const
+     */
+    std::optional<std::string_view> get(std::string_view name) const {
+        return view().get(name);
+    }
+
+    /**
+     * \see View::get(std::string_view, std::string_view) const
+     */
+    std::string_view get(std::string_view name, std::string_view fallback) const {
+        return view().get(name, fallback);
+    }
+
+    bool contains(std::string_view name) const {
+        return view().contains(name);
+    }
+
+    /**
+     * \see View::getInt()
+     */
+    std::optional<int64_t> getInt(std::string_view name) const {
+        return view().getInt(name);
+    }
+
+    /**
+     * \see View::getBool()
+     */
+    std::optional<bool> getBool(std::string_view name) const {
+        return view().getBool(name);
+    }
+
+    /**
+     * \see View::getList()
+     */
+    std::span<const std::string_view> getList(std::string_view name) const {
+        return view().getList(name);
+    }
+
+    /**
+     * Applies several changes at once. A value of std::nullopt unsets the variable. Readers see either none or all of
+     * the changes.
+     */
+    void update(const std::map<std::string, std::optional<std::string>>& changes) {
+        std::lock_guard l(writeLock);
+        const auto* state = current.load(std::memory_order_acquire);
+
+        std::vector<std::pair<std::string_view, std::string_view>> pairs;
+        pairs.reserve(state->entries.size() + changes.size());
+        for (const auto& [key, entry] : state->entries) {
+            if (!changes.contains(std::string(key))) {
+                pairs.emplace_back(key, entry.value);
+            }
+        }
+        for (const auto& [key, value] : changes) {
+            if (value.has_value()) {
+                pairs.emplace_back(key, *value);
+            }
+        }
+        publish(std::make_unique<State>(pairs));
+    }
+
+    void set(const std::string& name, const std::string& value) {
+        update({{name, value}});
+    }
+
+    void unset(const std::string& name) {
+        update({{name, std::nullopt}});
+    }
+
+    /**
+     * Re-reads the process environment, discarding any changes made with update(). Must not race with setenv or
+     * friends.
+     */
+    void reload() {
+        std::lock_guard l(writeLock);
+        publish(std::make_unique<State>(readEnviron()));
+    }
+
+    /**
+     * \returns the number of variables in the snapshot.
+     */
+    size_t size() const {
+        return view().size();
+    }
+
+    /**
+     * \returns a process-wide snapshot, created the first time this is called.
+     */
+    static EnvSnapshot& getInstance() {
+        static EnvSnapshot snapshot;
+        return snapshot;
+    }
+};
+
+}
+
+#undef STC_ENVIRON
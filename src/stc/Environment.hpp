@@ -1,17 +1,25 @@
 /** \file */
 #pragma once
 
+#include <algorithm>
 #include <filesystem>
 #include <optional>
+#include <span>
+#include <string_view>
+#include <unordered_map>
 #include <stdexcept>
 #include <string>
 #include <cstdlib>
-#include <regex>
 #include <array>
 #include <cstdio>
 #include <iostream>
+#include <memory>
+#include <vector>
 
 #if !defined(_WIN32)
+#include <cerrno>
+#include <mutex>
+#include <shared_mutex>
 #include <unistd.h>
 #include <sys/types.h>
 #include <pwd.h>
@@ -89,80 +97,153 @@ inline std::string getEnv(const char* name, const std::string& fail = "") {
 #endif
 }
 
+namespace _detail {
+
+#if defined(_WIN32) || defined(_WIN64)
+/**
+ * Looks up the current user's home directory from the environment. Windows doesn't have an equivalent of getpwnam, so
+ * this is all there is.
+ *
+ * \returns the home directory, or an empty string if it couldn't be found.
+ */
+inline std::string getWindowsHome() {
+    auto userProfile = getEnv("USERPROFILE");
+    if (!userProfile.empty()) {
+        return userProfile;
+    }
+    auto envHomePath = getEnv("HOMEPATH");
+    if (envHomePath.empty()) {
+        return "";
+    }
+    return getEnv("HOMEDRIVE") + envHomePath;
+}
+#else
+/**
+ * Thread-safe cache of user to home directory mappings. getpwnam and getpwuid return pointers to static storage, so
+ * they can't be called concurrently, and they're not exactly fast either, as they potentially go through NSS. This
+ * uses the reentrant variants, and only does the lookup once per user.
+ *
+ * Failed lookups are not cached, as they're generally fatal anyway.
+ */
+class HomeDirectoryCache {
+private:
+    std::shared_mutex lock;
+    std::unordered_map<std::string, std::string> homes;
+    std::optional<std::string> currentUserHome;
+
+    /**
+     * Calls getpwnam_r or getpwuid_r, growing the buffer if needed.
+     */
+    template <typename Lookup>
+    static std::optional<std::string> lookup(Lookup func) {
+        long initialSize = sysconf(_SC_GETPW_R_SIZE_MAX);
+        std::vector<char> buff(initialSize > 0 ? static_cast<size_t>(initialSize) : 16384);
+
+        struct passwd entry;
+        struct passwd* result = nullptr;
+        int err;
+        while ((err = func(&entry, buff.data(), buff.size(), &result)) == ERANGE) {
+            buff.resize(buff.size() * 2);
+        }
+        if (err != 0 || result == nullptr || result->pw_dir == nullptr) {
+            return std::nullopt;
+        }
+        return std::string(result->pw_dir);
+    }
+
+public:
+    /**
+     * \param username  The user to look up, or std::nullopt for the current user
+     * \returns the user's home directory, or std::nullopt if the user doesn't exist.
+     */
+    std::optional<std::string> get(const std::optional<std::string_view>& username) {
+        {
+            std::shared_lock l(lock);
+            if (!username.has_value()) {
+                if (currentUserHome.has_value()) {
+                    return currentUserHome;
+                }
+            } else if (auto it = homes.find(std::string(*username)); it != homes.end()) {
+                return it->second;
+            }
+        }
+
+        std::optional<std::string> home;
+        if (!username.has_value()) {
+            // While the home environment variable can be used, getenv() is considered insecure, and secure_getenv is
+            // only available on GNU/Linux, and not Mac. The passwd database is used instead, as it works everywhere.
+            auto uid = getuid();
+            home = lookup([uid](passwd* entry, char* buff, size_t size, passwd** result) {
+                return getpwuid_r(uid, entry, buff, size, result);
+            });
+        } else {
+            std::string name(*username);
+            home = lookup([&name](passwd* entry, char* buff, size_t size, passwd** result) {
+                return getpwnam_r(name.c_str(), entry, buff, size, result);
+            });
+        }
+        if (!home.has_value()) {
+            return std::nullopt;
+        }
+
+        std::unique_lock l(lock);
+        if (!username.has_value()) {
+            currentUserHome = home;
+        } else {
+            homes.emplace(std::string(*username), *home);
+        }
+        return home;
+    }
+
+    /**
+     * Clears the cache. Only useful if users are added or their home directories change at runtime.
+     */
+    void clear() {
+        std::unique_lock l(lock);
+        homes.clear();
+        currentUserHome.reset();
+    }
+
+    static HomeDirectoryCache& getInstance() {
+        static HomeDirectoryCache cache;
+        return cache;
+    }
+};
+#endif
+
+}
+
 /**
  * Expands a user path (AKA a path starting with ~), independently of the OS. Returns the path unmodified if the path
- * isn't a user path.
+ * isn't a user path. Backslashes are converted to forward slashes in either case.
  *
- * This requires several OS-specific calls (specifically between Windows and UNIX, from what I can tell.
- * There's not much of a difference in this area between for an instance Linux and Mac. Special
- * implementation requirements will be taken when we get to a point where it's needed)
+ * On UNIX, both `~` and `~username` are supported. Home directories are looked up in the passwd database, and cached,
+ * so this is safe to call from several threads at once. On Windows, only `~` is supported, as Windows has a very limited
+ * API for expanding user paths, and relies on environment variables and assumptions instead.
+ *
+ * \throws std::runtime_error if the home directory can't be found.
  */
 inline std::filesystem::path expandUserPath(const std::string& inputPath) {
     // Convert all backslashes to forward slashes for processing (fuck you Windows)
-    std::string rawPath = std::regex_replace(inputPath, std::regex("\\\\"), "/");
+    std::string rawPath = inputPath;
+    std::replace(rawPath.begin(), rawPath.end(), '\\', '/');
 
     // In order to universally support paths without doing a hacky if-check elsewhere,
     // this just returns the path itself if it isn't a home path.
     // Other paths should work themselves out
-    if (rawPath.at(0) != '~')
+    if (rawPath.empty() || rawPath.front() != '~') {
         return rawPath;
-
-    std::optional<std::string> username;
-    std::string remainingPath;
-
-    // The next part of the code is used to parse off the username,
-    // and grab the rest of the path. This is necessary to reconstruct
-    // the path afterwards.
-    std::string mod = rawPath.substr(1);
-    std::vector<std::string> pathSplit; // = StrUtil::splitString(mod, "/", 1);
-
-    // splitString but smaller so I don't have to import everything
-    size_t pos = 0;
-    std::string token, cache;
-    pos = mod.find('/');
-    token = mod.substr(0, pos);
-    cache = mod;
-    cache.erase(0, pos + 1);
-    pathSplit.push_back(token);
-    pathSplit.push_back(cache);
-
-    //  Parse off the username
-    if (rawPath.length() >= 2 && rawPath.at(1) != '/') {
-        // ~username
-        // ~username/path
-        username = pathSplit.at(0);
-        remainingPath = pathSplit.at(1);
-    } else if (rawPath.find('/') != std::string::npos) {
-        // The path contains a slash.
-
-        remainingPath = pathSplit.at(1);
     }
 
-    // We've by now found a username or not. This means we can actually expand
-    // the path.
+    // ~, ~/path, ~username, or ~username/path
+    std::string_view view(rawPath);
+    auto slash = view.find('/');
+    std::string_view username = view.substr(1, slash == std::string_view::npos ? std::string_view::npos : slash - 1);
+    std::string_view remainingPath = slash == std::string_view::npos ? "" : view.substr(slash + 1);
 
-    std::string homePath = "";
+    std::string homePath;
 #if defined(_WIN32) || defined(_WIN64)
-
-    if (!username.has_value()) {
-        auto userProfile = getEnv("USERPROFILE");
-
-        if (userProfile.empty()) {
-            auto homeDrive = getEnv("HOMEDRIVE");
-            if (homeDrive.empty())
-                homeDrive = "";
-
-            auto envHomePath = getEnv("HOMEPATH");
-
-            if (envHomePath.empty()) {
-                throw std::runtime_error("Unable to find %HOMEPATH%. Specify the path explicitly instead.");
-                //return "";
-            }
-            homePath = homeDrive + envHomePath;
-        } else
-            homePath = userProfile;
-
-    } else {
+    if (!username.empty()) {
         throw std::runtime_error("This doesn't work."
                      " Due to Windows having a very limited API for expanding user paths, and it relies on environment "
                      "variables and assumptions, me (the developer), has decided to not implement ~user expansion on "
@@ -171,120 +252,79 @@ inline std::filesystem::path expandUserPath(const std::string& inputPath) {
                      "use. "
                      "Replace your path with an absolute path instead. An implementation for this feature may be "
                      "available in the future.");
-        //return "";
+    }
+    homePath = _detail::getWindowsHome();
+    if (homePath.empty()) {
+        throw std::runtime_error("Unable to find %HOMEPATH%. Specify the path explicitly instead.");
     }
     // Force forward slashes
-    homePath = std::regex_replace(homePath, std::regex("\\\\"), "/");
-
+    std::replace(homePath.begin(), homePath.end(), '\\', '/');
 #else
-    /*
-     The unixes are easier, because they should in theory share a single
-     API that makes this a whole lot easier.
-     The idea is checking for HOME if we're looking for the current user.
-     If we can't find the home variable, fall back to a UNIX-specific^1
-     function that retrieves the path, along with a few other details.
-     see getpwnam(3) for more info on the functions, and passwd(5)
-     for details on the struct. This code drops the HOME variable for
-     various reasons.
-     If a username has been supplied (~username/), getpwnam is used instead
-     of getpwuid. This returns the same type of struct as getpwuid().
-     The bonus with the UNIX approach is that it requires the user to exist,
-     where as Windows for non-existent users with a custom specified path should
-     in theory cause a bad path. This is on the user, however.
-     ^1: untested on mac and other UNIX-based systems. Only verified on Linux.
-    */
-    struct passwd* passwdPtr = nullptr;
-
-    if (!username.has_value()) {
-        // While the home environment variable can be used,
-        // getenv() is considered insecure
-        // secure_getenv is only available on GNU/Linux, and not Mac.
-        // Mac is still compatible with the rest of the code,
-        // so no environment variables are used
-        passwdPtr = getpwuid(getuid());
-    } else {
-        auto& name = *username;
-        passwdPtr = getpwnam(name.c_str());
-    }
-
-    if (passwdPtr == nullptr) {
+    auto home = _detail::HomeDirectoryCache::getInstance().get(
+        username.empty() ? std::nullopt : std::optional<std::string_view>(username)
+    );
+    if (!home.has_value()) {
         throw std::runtime_error(std::string("Failed to expand the user path for ") + rawPath + ". The system seems to think you don't exist. "
                      "Please specify the path to use - don't abbreviate it with ~.\n");
     }
-    homePath = passwdPtr->pw_dir;
+    homePath = std::move(*home);
 #endif
     return std::filesystem::path{homePath} / remainingPath;
 }
 
+/**
+ * Batch version of expandUserPath(const std::string&), for expanding large numbers of paths at once. Each distinct user
+ * is only looked up once per call, so the shared cache is barely touched.
+ *
+ * \throws std::runtime_error if any of the home directories can't be found.
+ */
+inline std::vector<std::filesystem::path> expandUserPaths(std::span<const std::string> inputPaths) {
+    std::vector<std::filesystem::path> out;
+    out.reserve(inputPaths.size());
+
+    // Maps the ~username prefix (without the slash) to the expanded home directory
+    std::unordered_map<std::string, std::filesystem::path> homes;
+    for (const auto& inputPath : inputPaths) {
+        if (inputPath.empty() || inputPath.front() != '~') {
+            out.push_back(expandUserPath(inputPath));
+            continue;
+        }
+        auto slash = inputPath.find_first_of("/\\");
+        std::string prefix = inputPath.substr(0, slash);
+        auto it = homes.find(prefix);
+        if (it == homes.end()) {
+            it = homes.emplace(prefix, expandUserPath(prefix + "/")).first;
+        }
+
+        std::string remainingPath = slash == std::string::npos ? "" : inputPath.substr(slash + 1);
+        std::replace(remainingPath.begin(), remainingPath.end(), '\\', '/');
+        out.push_back(it->second / remainingPath);
+    }
+    return out;
+}
+
 /**
  * Returns the user's home directory. 
  *
  * Note that the windows implementation is wank, and may not be as reliable as the UNIX implementation. 
  */
 inline std::filesystem::path getHome() {
-
-    std::optional<std::string> username;
-
-    std::string homePath = "";
 #if defined(_WIN32) || defined(_WIN64)
-    auto userProfile = getEnv("USERPROFILE");
-
-    if (userProfile.empty()) {
-        auto homeDrive = getEnv("HOMEDRIVE");
-        if (homeDrive.empty())
-            homeDrive = "";
-
-        auto envHomePath = getEnv("HOMEPATH");
-
-        if (envHomePath.empty()) {
-            throw std::runtime_error("Failed to find home path");
-        }
-        homePath = homeDrive + envHomePath;
-    } else
-        homePath = userProfile;
-
+    auto homePath = _detail::getWindowsHome();
+    if (homePath.empty()) {
+        throw std::runtime_error("Failed to find home path");
+    }
     // Force forward slashes
-    homePath = std::regex_replace(homePath, std::regex("\\\\"), "/");
-
+    std::replace(homePath.begin(), homePath.end(), '\\', '/');
+    return std::filesystem::path{homePath};
 #else
-    /*
-     The unixes are easier, because they should in theory share a single
-     API that makes this a whole lot easier.
-     The idea is checking for HOME if we're looking for the current user.
-     If we can't find the home variable, fall back to a UNIX-specific^1
-     function that retrieves the path, along with a few other details.
-     see getpwnam(3) for more info on the functions, and passwd(5)
-     for details on the struct. This code drops the HOME variable for
-     various reasons.
-     If a username has been supplied (~username/), getpwnam is used instead
-     of getpwuid. This returns the same type of struct as getpwuid().
-     The bonus with the UNIX approach is that it requires the user to exist,
-     where as Windows for non-existent users with a custom specified path should
-     in theory cause a bad path. This is on the user, however.
-     ^1: untested on mac and other UNIX-based systems. Only verified on Linux.
-    */
-    struct passwd* passwdPtr = nullptr;
-
-    // While the home environment variable can be used,
-    // getenv() is considered insecure
-    // secure_getenv is only available on GNU/Linux, and not Mac.
-    // Mac is still compatible with the rest of the code,
-    // so no environment variables are used
-    //
-    // The odds that this presents a threat are probably tiny,
-    // but hey, if I'm putting shit in a ton of projects, I'm
-    // gonna make sure I do it properly.
-    //
-    // Also, LOOK AT HOW EASY THIS IS! It's literally 6 lines
-    // of code, and one API call, instead of that if-statement cascade bullshit Windows needs
-    passwdPtr = getpwuid(getuid());
-
-    if (passwdPtr == nullptr) {
+    // See expandUserPath for why this doesn't just read $HOME
+    auto homePath = _detail::HomeDirectoryCache::getInstance().get(std::nullopt);
+    if (!homePath.has_value()) {
         throw std::runtime_error("Failed to find home directory");
     }
-    homePath = passwdPtr->pw_dir;
+    return std::filesystem::path{*homePath};
 #endif
-    return std::filesystem::path{homePath};
 }
 
 /**
@@ -295,10 +335,12 @@ inline std::filesystem::path getHome() {
  * `std::system`, requires significant input cleaning before use. If you're dealing with user input, use
  * syscommand(std::vector<const char*>, int*) instead.
  *
+ * On UNIX, stc::Unix::syscommand() (in stc/unix/Process.hpp) can skip the shell for simple commands.
+ *
  * \see https://pubs.opengroup.org/onlinepubs/9699919799/functions/popen.html
  */
 inline std::string syscommand(const std::string& command, int* codeOutput = nullptr) {
-    std::array<char, 128> buffer;
+    std::vector<char> buffer(1 << 16);
     std::string res;
 
     std::unique_ptr<std::FILE, void(*)(FILE*)> fd {
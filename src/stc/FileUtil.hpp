@@ -5,6 +5,7 @@
 #pragma once
 
 #include <filesystem>
+#include <functional>
 #include <optional>
 #include <vector>
 
@@ -30,4 +31,31 @@ inline std::optional<std::filesystem::path> findFile(
     return std::nullopt;
 }
 
+/**
+ * Same as findFile(const std::vector<std::filesystem::path>&, const std::filesystem::path&), but with an additional
+ * predicate that has to accept the candidate path for it to be returned. This is useful if you're looking for a file
+ * with specific properties, such as an executable file when doing PATH lookups. If the predicate rejects a candidate,
+ * the search continues in the next search path.
+ *
+ * \param searchPath    A list of directories to search in
+ * \param filename      The filename or relative path to find
+ * \param predicate     Called with each existing candidate. Must return true for the candidate to be accepted.
+ *
+ * \returns             A path to a file that exists and is accepted by the predicate, or std::nullopt if no such file
+ *                      exists in the search path.
+ */
+inline std::optional<std::filesystem::path> findFile(
+    const std::vector<std::filesystem::path>& searchPath,
+    const std::filesystem::path& filename,
+    const std::function<bool(const std::filesystem::path&)>& predicate
+) {
+    for (auto& path : searchPath) {
+        auto candidate = path / filename;
+        if (std::filesystem::is_regular_file(candidate) && predicate(candidate)) {
+            return candidate;
+        }
+    }
+    return std::nullopt;
+}
+
 }
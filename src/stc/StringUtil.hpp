@@ -5,7 +5,9 @@
 #pragma once
 
 #include <algorithm>
+#include <stdexcept>
 #include <string>
+#include <string_view>
 #include <sstream>
 #include <vector>
 #include <iostream>
@@ -170,4 +172,123 @@ inline bool equalsIgnoreCaseAscii(const std::string& a, const std::string& b) {
     return true;
 }
 
+/**
+ * Splits a string into words according to the POSIX shell quoting rules. Single quotes, double quotes, and backslash
+ * escapes are handled, and removed from the output, but nothing is expanded: `$HOME`, `*`, `~`, and friends are
+ * returned as-is.
+ *
+ * Shell syntax that can't be represented as a plain list of arguments is still tokenized as if it were literal text,
+ * but is reported through requiresShell. This covers unquoted operators (`|`, `&`, `;`, `<`, `>`, `(`, `)`, newlines),
+ * globs (`*`, `?`, `[`), expansions (`$` and backticks, including inside double quotes), comments, tildes, braces, and
+ * variable assignments before the command. Reserved words and builtins are not detected, as they're just words.
+ *
+ * \param input         The string to split
+ * \param requiresShell If not null, set to whether or not the input uses shell features that the tokenizer doesn't
+ *                      implement.
+ * \throws std::runtime_error if the input has an unterminated quote, or ends in an unescaped backslash.
+ *
+ * \see https://pubs.opengroup.org/onlinepubs/9699919799/utilities/V3_chap02.html#tag_18_02
+ */
+inline std::vector<std::string> splitShellWords(std::string_view input, bool* requiresShell = nullptr) {
+    std::vector<std::string> out;
+    std::string word;
+    // Needed to tell an empty quoted word ("") apart from no word at all
+    bool inWord = false;
+    bool shell = false;
+
+    auto endWord = [&]() {
+        if (inWord) {
+            out.push_back(std::move(word));
+            word.clear();
+            inWord = false;
+        }
+    };
+
+    for (size_t i = 0; i < input.size(); ++i) {
+        char ch = input[i];
+        switch (ch) {
+        case ' ':
+        case '\t':
+            endWord();
+            break;
+        case '\\':
+            if (i + 1 >= input.size()) {
+                throw std::runtime_error("Trailing backslash in shell string");
+            }
+            ++i;
+            // Backslash-newline is a line continuation, and is removed entirely
+            if (input[i] != '\n') {
+                word += input[i];
+                inWord = true;
+            }
+            break;
+        case '\'': {
+            auto end = input.find('\'', i + 1);
+            if (end == std::string_view::npos) {
+                throw std::runtime_error("Unterminated single quote in shell string");
+            }
+            word.append(input.substr(i + 1, end - i - 1));
+            inWord = true;
+            i = end;
+        } break;
+        case '"': {
+            inWord = true;
+            ++i;
+            for (; i < input.size() && input[i] != '"'; ++i) {
+                if (input[i] == '$' || input[i] == '`') {
+                    shell = true;
+                } else if (input[i] == '\\' && i + 1 < input.size()) {
+                    // Inside double quotes, backslashes only escape these characters, and are left as-is otherwise
+                    char next = input[i + 1];
+                    if (next == '$' || next == '`' || next == '"' || next == '\\' || next == '\n') {
+                        ++i;
+                        if (next != '\n') {
+                            word += next;
+                        }
+                        continue;
+                    }
+                }
+                word += input[i];
+            }
+            if (i >= input.size()) {
+                throw std::runtime_error("Unterminated double quote in shell string");
+            }
+        } break;
+        case '|': case '&': case ';': case '<': case '>': case '(': case ')': case '\n':
+        case '$': case '`': case '*': case '?': case '[': case '{': case '}':
+            shell = true;
+            word += ch;
+            inWord = true;
+            break;
+        case '#':
+        case '~':
+            // Only special at the start of a word
+            if (!inWord) {
+                shell = true;
+            }
+            word += ch;
+            inWord = true;
+            break;
+        case '=':
+            // NAME=value before the command is an assignment, not an argument. This is slightly over-eager, as it also
+            // catches things like `a"b"=c` and `1=2`, but false positives only cost performance.
+            if (out.empty()) {
+                shell = true;
+            }
+            word += ch;
+            inWord = true;
+            break;
+        default:
+            word += ch;
+            inWord = true;
+        }
+    }
+    endWord();
+
+    if (requiresShell != nullptr) {
+        *requiresShell = shell;
+    }
+    return out;
+}
+
 }
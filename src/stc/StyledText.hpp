@@ -0,0 +1,307 @@
+/** \file
+ *
+ * Contains a styled text builder that only emits the SGR parameters that change between spans. See
+ * stc::colour::StyledText.
+ */
+#pragma once
+
+#include <cerrno>
+#include <cstdint>
+#include <iterator>
+#include <ostream>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "Colour.hpp"
+
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+namespace stc::colour {
+
+namespace _detail {
+
+constexpr uint32_t typographyBit(Typography feature) {
+    return uint32_t(1) << static_cast<int>(feature);
+}
+
+}
+
+/**
+ * Builder for text where different parts have different styles, like tables or syntax highlighted code.
+ *
+ * Writing each part with the stream manipulators means each part gets a full set of escape codes and a reset, even if
+ * the neighbouring part has the same or almost the same style. StyledText instead records the text and its style, and
+ * works out the smallest transition between each pair of styles when rendering. Adjacent spans with the same style are
+ * merged, parameters that don't change aren't repeated, and all the parameters for one transition are written as a
+ * single SGR sequence. If turning features off would take more space than resetting everything, a reset is used
+ * instead.
+ *
+ * Typography is treated as a set of enabled features, so only BOLD, FAINT, ITALIC, UNDERLINE, and SLOW_BLINK are
+ * meaningful in a span's Style. The off-codes (RESET_INTENSITY, NO_ITALIC, etc.) are used internally for transitions,
+ * and are ignored if they're part of a span's Style.
+ *
+ * Example use:
+ * ```cpp
+ * stc::colour::StyledText text;
+ * auto header = stc::colour::Style::of(stc::colour::Typography::BOLD);
+ * text.append("Name", header)
+ *     .append(" | ")
+ *     .append("Value\n", header);
+ * text.writeTo(std::cout);
+ * ```
+ */
+class StyledText {
+public:
+    struct Span {
+        size_t offset;
+        size_t size;
+        Style style;
+    };
+
+private:
+    std::string text;
+    std::vector<Span> spans;
+
+    // Typography features that are tracked as state
+    static constexpr uint32_t intensityMask = _detail::typographyBit(Typography::BOLD)
+        | _detail::typographyBit(Typography::FAINT);
+    static constexpr uint32_t stateMask = intensityMask
+        | _detail::typographyBit(Typography::ITALIC)
+        | _detail::typographyBit(Typography::UNDERLINE)
+        | _detail::typographyBit(Typography::SLOW_BLINK);
+
+    static Style normalise(Style style) {
+        style.typography &= stateMask;
+        return style;
+    }
+
+    /**
+     * Collects the parameters needed to go from one style to another without a reset.
+     */
+    static void diffParams(const Style& from, const Style& to, std::vector<int>& out) {
+        uint32_t removed = from.typography & ~to.typography;
+        uint32_t added = to.typography & ~from.typography;
+
+        // BOLD and FAINT share an off-code, so turning one off turns both off, and the other may need to be turned
+        // back on
+        if ((removed & intensityMask) != 0) {
+            out.push_back(static_cast<int>(Typography::RESET_INTENSITY));
+            added |= to.typography & intensityMask;
+        }
+        if ((removed & _detail::typographyBit(Typography::ITALIC)) != 0) {
+            out.push_back(static_cast<int>(Typography::NO_ITALIC));
+        }
+        if ((removed & _detail::typographyBit(Typography::UNDERLINE)) != 0) {
+            out.push_back(static_cast<int>(Typography::NO_UNDERLINE));
+        }
+        if ((removed & _detail::typographyBit(Typography::SLOW_BLINK)) != 0) {
+            out.push_back(static_cast<int>(Typography::NO_BLINKING));
+        }
+        for (int i = 0; i < 32; ++i) {
+            if ((added & (uint32_t(1) << i)) != 0) {
+                out.push_back(i);
+            }
+        }
+
+        auto push = [&](int param) { out.push_back(param); };
+        if (from.fg != to.fg) {
+            if (to.fg.type == Colour::Type::DEFAULT) {
+                out.push_back(39);
+            } else {
+                Style::forEachColourParam(to.fg, _detail::FOREGROUND, push);
+            }
+        }
+        if (from.bg != to.bg) {
+            if (to.bg.type == Colour::Type::DEFAULT) {
+                out.push_back(49);
+            } else {
+                Style::forEachColourParam(to.bg, _detail::BACKGROUND, push);
+            }
+        }
+    }
+
+    static size_t paramsSize(const std::vector<int>& params) {
+        size_t size = params.empty() ? 0 : params.size() - 1;
+        for (auto param : params) {
+            size += param >= 100 ? 3 : param >= 10 ? 2 : 1;
+        }
+        return size;
+    }
+
+    /**
+     * Writes the shortest sequence that goes from one style to the other. diff and reset are scratch buffers, passed in
+     * so they can be reused between transitions.
+     */
+    static void writeTransition(
+        std::string& out,
+        const Style& from,
+        const Style& to,
+        std::vector<int>& diff,
+        std::vector<int>& reset
+    ) {
+        if (from == to) {
+            return;
+        }
+        diff.clear();
+        diffParams(from, to, diff);
+
+        // Compare against a full reset followed by the new style
+        reset.assign(1, 0);
+        to.forEachParam([&](int param) { reset.push_back(param); });
+        const auto& chosen = paramsSize(reset) < paramsSize(diff) ? reset : diff;
+
+        out += "\033[";
+        for (size_t i = 0; i < chosen.size(); ++i) {
+            if (i != 0) {
+                out += ';';
+            }
+            Style::writeParam(std::back_inserter(out), chosen[i]);
+        }
+        out += 'm';
+    }
+
+public:
+    /**
+     * Appends text with a style. If the style is the same as the previous span's style, the previous span is extended
+     * instead.
+     */
+    StyledText& append(std::string_view content, const Style& style = {}) {
+        if (content.empty()) {
+            return *this;
+        }
+        auto normalised = normalise(style);
+        if (!spans.empty() && spans.back().style == normalised) {
+            spans.back().size += content.size();
+        } else {
+            spans.push_back({ text.size(), content.size(), normalised });
+        }
+        text.append(content);
+        return *this;
+    }
+
+    template <typename... Parts>
+    StyledText& append(std::string_view content, Foreground part, Parts... parts) {
+        return append(content, Style::of(part, parts...));
+    }
+    template <typename... Parts>
+    StyledText& append(std::string_view content, Background part, Parts... parts) {
+        return append(content, Style::of(part, parts...));
+    }
+    template <typename... Parts>
+    StyledText& append(std::string_view content, Typography part, Parts... parts) {
+        return append(content, Style::of(part, parts...));
+    }
+
+    void clear() {
+        text.clear();
+        spans.clear();
+    }
+
+    /**
+     * \returns the text, without any styling.
+     */
+    const std::string& plain() const {
+        return text;
+    }
+
+    const std::vector<Span>& getSpans() const {
+        return spans;
+    }
+
+    /**
+     * Renders the text into the end of `out`.
+     *
+     * \param colour    Whether or not to include escape codes. If false, this is equivalent to appending plain().
+     */
+    void renderTo(std::string& out, bool colour = true) const {
+        renderTo(out, colour ? ColourDepth::TRUECOLOUR : ColourDepth::NONE);
+    }
+
+    /**
+     * Renders the text into the end of `out`, with colours downgraded to the given depth. NONE is equivalent to
+     * appending plain().
+     */
+    void renderTo(std::string& out, ColourDepth depth) const {
+        if (depth == ColourDepth::NONE) {
+            out += text;
+            return;
+        }
+        // Rough estimate to avoid most reallocations
+        out.reserve(out.size() + text.size() + spans.size() * 8);
+
+        Style current;
+        std::vector<int> diff, reset;
+        for (const auto& span : spans) {
+            // Downgrading can make neighbouring styles identical, in which case writeTransition writes nothing
+            auto style = span.style.downgrade(depth);
+            writeTransition(out, current, style, diff, reset);
+            current = style;
+            out.append(text, span.offset, span.size);
+        }
+        if (!current.empty()) {
+            Style::writeReset(std::back_inserter(out));
+        }
+    }
+
+    std::string render(bool colour = true) const {
+        std::string out;
+        renderTo(out, colour);
+        return out;
+    }
+
+    std::string render(ColourDepth depth) const {
+        std::string out;
+        renderTo(out, depth);
+        return out;
+    }
+
+    /**
+     * Writes the rendered text to a stream, using the same TTY, force, and depth semantics as the stream manipulators.
+     */
+    void writeTo(std::ostream& stream) const {
+        auto rendered = render(_detail::getColourDepth(stream));
+        stream.write(rendered.data(), static_cast<std::streamsize>(rendered.size()));
+    }
+
+    /**
+     * Writes the rendered text directly to a file descriptor. There's no stream to check, so whether the fd should be
+     * coloured is up to the caller. If it is, colours are downgraded to getTerminalColourDepth(), as with a TTY stream.
+     *
+     * \throws std::runtime_error if the write fails.
+     */
+    void writeTo(int fd, bool colour = true) const {
+        writeTo(fd, colour ? getTerminalColourDepth() : ColourDepth::NONE);
+    }
+
+    /**
+     * Writes the text rendered with the given depth directly to a file descriptor.
+     *
+     * \throws std::runtime_error if the write fails.
+     */
+    void writeTo(int fd, ColourDepth depth) const {
+        auto rendered = render(depth);
+        std::string_view remaining(rendered);
+        while (!remaining.empty()) {
+#ifdef _WIN32
+            auto written = _write(fd, remaining.data(), static_cast<unsigned int>(remaining.size()));
+#else
+            auto written = ::write(fd, remaining.data(), remaining.size());
+#endif
+            if (written < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                throw std::runtime_error("Failed to write styled text");
+            }
+            remaining.remove_prefix(static_cast<size_t>(written));
+        }
+    }
+};
+
+}
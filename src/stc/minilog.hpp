@@ -1,16 +1,70 @@
 /** \file */
 #pragma once
 
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cerrno>
+#include <charconv>
 #include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <ctime>
 #include <format>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
 #include "Colour.hpp"
 
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
 /**
  * \brief Module containing a small logger. 
  *
  * Does the bare minimum to be a fancy terminal logger. Based on <format> with some features from <stc/Colour.hpp> used.
  *
+ * By default, each record is formatted into a per-thread buffer, and written to stdout with a single write() on the
+ * calling thread. This bypasses std::cout, so anything written to std::cout without a newline or flush may show up
+ * after later log records. The output fd can be changed with minilog::setOutput, and minilog::startFileSink writes to
+ * rotating files instead. For programs that log a lot from several threads, minilog::startAsync moves the I/O to a
+ * background thread; see its docs for details.
+ *
+ * ## Levels
+ *
+ * Records below the runtime level (`minilog::config().level`, or minilog::setLevel) are skipped, but the arguments are
+ * still evaluated, and the check still happens. Defining `MINILOG_MIN_LEVEL` before including minilog removes every
+ * call below that level at compile time:
+ * ```cpp
+ * // Or -DMINILOG_MIN_LEVEL=60
+ * #define MINILOG_MIN_LEVEL minilog::Level::Info
+ * #include <stc/minilog.hpp>
+ * ```
+ * MINILOG_MIN_LEVEL must be the same in every translation unit. To skip evaluating the arguments as well, use the
+ * MINILOG_LOG macro.
  */
+
+#ifndef MINILOG_MIN_LEVEL
+#define MINILOG_MIN_LEVEL 0
+#endif
+
 namespace minilog {
 
 enum Level {
@@ -21,21 +75,124 @@ enum Level {
     Critical = 90
 };
 
+/**
+ * The compile-time minimum level. Calls below this level compile to nothing.
+ */
+inline constexpr int minLevel = static_cast<int>(MINILOG_MIN_LEVEL);
+
+enum class RecordFormat {
+    /**
+     * `HH:MM:SS.mmm | level    | message key=value`, coloured by level if colour is enabled. Meant for people.
+     */
+    TEXT,
+    /**
+     * logfmt: `time=YYYY-MM-DDTHH:MM:SS.mmmZ level=info msg="message" key=value`. Values are quoted when they need to
+     * be.
+     */
+    LOGFMT,
+    /**
+     * One JSON object per line: `{"time":"YYYY-MM-DDTHH:MM:SS.mmmZ","level":"info","msg":"message","key":value}`.
+     * Numbers and bools are written as JSON numbers and bools, and everything else as strings.
+     */
+    JSON,
+};
+
+/**
+ * A key-value pair for structured records. The value is held by reference, so a KV must not outlive the log call it's
+ * passed to; use kv() to create one in the call itself.
+ *
+ * Keys are written as-is in TEXT and LOGFMT, so they should be plain identifiers.
+ */
+template <typename T>
+struct KV {
+    std::string_view key;
+    const T& value;
+};
+
+template <typename T>
+constexpr KV<T> kv(std::string_view key, const T& value) {
+    return { key, value };
+}
+
 struct Config {
-    Level level = Level::Debug;
+    /**
+     * The runtime minimum level. Atomic, as it's read by every logging thread; relaxed ordering is used everywhere, as
+     * nothing else is synchronised through it.
+     */
+    std::atomic<Level> level = Level::Debug;
+
+    /**
+     * The fd records are written to when not in async mode. Use setOutput() to change it.
+     */
+    std::atomic<int> fd = 1;
+    /**
+     * 1 to colour records, 0 to not. -1 means it hasn't been resolved yet, and is resolved the first time something is
+     * logged. Use setOutput() to change it.
+     */
+    std::atomic<int> colour = -1;
+
+    /**
+     * The layout of every record. Machine-readable formats are never coloured. Use setFormat() to change it.
+     */
+    std::atomic<RecordFormat> format = RecordFormat::TEXT;
 };
 
+namespace _detail {
+
+// An inline variable rather than a function-local static, so reading the config doesn't go through a guard check.
+// Config is constant-initialised, so there's no initialisation order problem either.
+inline Config configInstance;
+
+}
+
 inline Config& config() {
-    // This should be fine:
-    // * https://stackoverflow.com/a/185730
-    // * https://stackoverflow.com/a/189162
-    //
-    // This is also consistent with getStreamConfigIdx in Colour.hpp. I vaguely remember running into this problem
-    // because shouldPrintColour is static, while getStreamConfigIdx is inline.
-    // I really should read up on what inline actually is, because I'm pretty sure I've misunderstood *something*
-    static Config instance;
+    return _detail::configInstance;
+}
+
+inline void setLevel(Level level) {
+    config().level.store(level, std::memory_order_relaxed);
+}
+
+/**
+ * Changes the layout of every record. Use RecordFormat::LOGFMT or RecordFormat::JSON when the output is read by
+ * something other than a person; colour is always disabled for those.
+ */
+inline void setFormat(RecordFormat format) {
+    config().format.store(format, std::memory_order_relaxed);
+}
+
+inline Level getLevel() {
+    return config().level.load(std::memory_order_relaxed);
+}
 
-    return instance;
+/**
+ * \returns whether or not a record at the given level would be logged.
+ */
+template <Level level>
+inline bool isEnabled() {
+    if constexpr (static_cast<int>(level) < minLevel) {
+        return false;
+    } else {
+        return getLevel() <= level;
+    }
+}
+
+/**
+ * \returns the level name, padded to the width of the longest name.
+ */
+template <Level level>
+consteval std::string_view levelToPaddedString() {
+    if constexpr (level == Level::Debug) {
+        return "debug   ";
+    } else if constexpr (level == Level::Info) {
+        return "info    ";
+    } else if constexpr (level == Level::Warning) {
+        return "warning ";
+    } else if constexpr (level == Level::Error) {
+        return "error   ";
+    } else if constexpr (level == Level::Critical) {
+        return "critical";
+    }
 }
 
 template <Level level>
@@ -68,31 +225,2089 @@ inline constexpr std::ostream& operator<<(std::ostream& ss, Level level) {
     return ss;
 }
 
+/**
+ * What the async writer does when its queue is full.
+ */
+enum class OverflowPolicy {
+    /**
+     * The logging thread waits until there's space. Nothing is lost, but a slow output slows down every logging
+     * thread.
+     */
+    BLOCK,
+    /**
+     * The record is dropped. The number of dropped records is available through getDroppedCount().
+     */
+    DROP,
+    /**
+     * Same as DROP, but the writer thread also writes a line with the number of dropped records whenever records have
+     * been dropped, so the gaps are visible in the output.
+     */
+    COUNT,
+};
+
+struct AsyncConfig {
+    /**
+     * The maximum number of records waiting to be written. Rounded up to a power of two.
+     */
+    size_t capacity = 8192;
+    OverflowPolicy overflow = OverflowPolicy::BLOCK;
+    /**
+     * The file descriptor to write to.
+     */
+    int fd = 1;
+    /**
+     * Whether or not to colour the output. If std::nullopt, colour is used if the fd is a TTY, and the terminal
+     * supports colour.
+     */
+    std::optional<bool> colour = std::nullopt;
+};
+
+struct BinaryConfig {
+    /**
+     * The size of each thread's ring buffer in bytes. Rounded up to a power of two. Records that don't fit are dropped
+     * and counted, as the whole point of binary mode is that logging threads never wait.
+     */
+    size_t bufferSize = 1 << 20;
+    /**
+     * How often the consumer thread checks the ring buffers. Logging threads never wake the consumer, as that would
+     * be a syscall on the hot path.
+     */
+    std::chrono::milliseconds pollInterval = std::chrono::milliseconds(5);
+    int fd = 1;
+    std::optional<bool> colour = std::nullopt;
+};
+
+struct FileSinkConfig {
+    /**
+     * The base path of the log. Segments are written to `<path>.000000`, `<path>.000001`, and so on. Existing files
+     * are never overwritten; numbers that are taken are skipped.
+     */
+    std::string path;
+    /**
+     * The size each segment is preallocated to, and rotated at. Records larger than this get a segment of their own.
+     */
+    size_t segmentSize = 64 << 20;
+    /**
+     * How long a segment is written to before it's rotated, regardless of its size. Zero disables time-based rotation.
+     */
+    std::chrono::seconds rotateInterval = std::chrono::seconds(0);
+    /**
+     * How often the current segment is synced to disk. Zero leaves it to the OS, aside a sync when each segment is
+     * closed.
+     */
+    std::chrono::milliseconds fsyncInterval = std::chrono::seconds(1);
+    /**
+     * Whether to map each segment into memory, and write records with memcpy instead of pwrite(). Logging never makes
+     * a syscall in this mode, but the file is the full segment size until it's rotated, with zeroes after the last
+     * record.
+     *
+     * Only segments that could be preallocated are mapped, which currently means Linux, on a filesystem that supports
+     * fallocate(). Other segments are written with pwrite().
+     */
+    bool useMmap = false;
+    bool colour = false;
+};
+
+/**
+ * Whether or not a type can be copied into a binary log record as raw bytes, and formatted later on another thread.
+ * This is true for arithmetic types, enums, and void pointers. It's deliberately NOT true for trivially copyable types
+ * in general, as many of them (std::span, for example) point to data that may be gone by the time they're formatted.
+ *
+ * Strings (std::string, std::string_view, and C strings) are also supported, but are handled separately by copying the
+ * characters.
+ *
+ * Specialise this for your own trivially copyable types if they're safe to format after the fact.
+ */
+template <typename T>
+inline constexpr bool isBinarySafe = std::is_arithmetic_v<T>
+    || std::is_enum_v<T>
+    || std::is_same_v<T, std::nullptr_t>
+    || std::is_same_v<T, void*>
+    || std::is_same_v<T, const void*>;
+
+namespace _detail {
+
+/**
+ * Writes all of the data to the fd. Errors other than EINTR are ignored, as there's nowhere to report them.
+ */
+inline void writeAll(int fd, std::string_view data) {
+    while (!data.empty()) {
+#ifdef _WIN32
+        auto written = _write(fd, data.data(), static_cast<unsigned int>(data.size()));
+#else
+        auto written = ::write(fd, data.data(), data.size());
+#endif
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return;
+        }
+        data.remove_prefix(static_cast<size_t>(written));
+    }
+}
+
+inline bool isFdTTY(int fd) {
+#ifdef _WIN32
+    return _isatty(fd) != 0;
+#else
+    return ::isatty(fd) != 0;
+#endif
+}
+
+template <Level level>
+constexpr stc::colour::FourBitColour levelColour() {
+    if constexpr (level == Level::Debug) {
+        return stc::colour::FourBitColour::BRIGHT_BLACK;
+    } else if constexpr (level == Level::Info) {
+        return stc::colour::FourBitColour::BLUE;
+    } else if constexpr (level == Level::Warning) {
+        return stc::colour::FourBitColour::BRIGHT_YELLOW;
+    } else if constexpr (level == Level::Error) {
+        return stc::colour::FourBitColour::BRIGHT_RED;
+    } else {
+        return stc::colour::FourBitColour::RED;
+    }
+}
+
+/**
+ * Per-thread cache of the rendered timestamp. std::format's `%T` does a full calendar conversion for every record,
+ * which dominates the cost of short messages. The `HH:MM:SS.` part only changes once a second, so it's only rendered
+ * when the second changes, and the milliseconds are patched in with integer arithmetic.
+ *
+ * Like `{:%T}` with a system_clock time, the timestamp is in UTC. With `withDate`, the date is included as well, as an
+ * RFC 3339 timestamp (`YYYY-MM-DDTHH:MM:SS.mmmZ`), which is what the machine-readable formats use.
+ */
+template <bool withDate>
+class BasicTimestampCache {
+private:
+    static constexpr size_t timeOffset = withDate ? 11 : 0;
+
+    // [YYYY-MM-DDT]HH:MM:SS.mmm[Z]
+    std::array<char, timeOffset + 12 + (withDate ? 1 : 0)> buffer {};
+    std::chrono::sys_seconds second = std::chrono::sys_seconds::min();
+
+    static void writeTwoDigits(char* out, long value) {
+        out[0] = static_cast<char>('0' + value / 10);
+        out[1] = static_cast<char>('0' + value % 10);
+    }
+
+public:
+    std::string_view render(std::chrono::system_clock::time_point now) {
+        auto ms = std::chrono::floor<std::chrono::milliseconds>(now);
+        auto currentSecond = std::chrono::floor<std::chrono::seconds>(ms);
+        if (currentSecond != second) {
+            second = currentSecond;
+            auto day = std::chrono::floor<std::chrono::days>(currentSecond);
+            if constexpr (withDate) {
+                std::chrono::year_month_day date(day);
+                auto year = static_cast<long>(static_cast<int>(date.year()));
+                writeTwoDigits(buffer.data(), year / 100);
+                writeTwoDigits(buffer.data() + 2, year % 100);
+                buffer[4] = '-';
+                writeTwoDigits(buffer.data() + 5, static_cast<long>(static_cast<unsigned>(date.month())));
+                buffer[7] = '-';
+                writeTwoDigits(buffer.data() + 8, static_cast<long>(static_cast<unsigned>(date.day())));
+                buffer[10] = 'T';
+                buffer.back() = 'Z';
+            }
+            char* time = buffer.data() + timeOffset;
+            auto secondsOfDay = (currentSecond - day).count();
+            writeTwoDigits(time, static_cast<long>(secondsOfDay / 3600));
+            time[2] = ':';
+            writeTwoDigits(time + 3, static_cast<long>(secondsOfDay / 60 % 60));
+            time[5] = ':';
+            writeTwoDigits(time + 6, static_cast<long>(secondsOfDay % 60));
+            time[8] = '.';
+        }
+        auto millis = static_cast<long>((ms - currentSecond).count());
+        char* fraction = buffer.data() + timeOffset + 9;
+        fraction[0] = static_cast<char>('0' + millis / 100);
+        writeTwoDigits(fraction + 1, millis % 100);
+        return { buffer.data(), buffer.size() };
+    }
+};
+
+using TimestampCache = BasicTimestampCache<false>;
+using DateTimeCache = BasicTimestampCache<true>;
+
+/**
+ * Appends a character to `out`, escaped for a JSON string. logfmt uses the same escapes.
+ */
+inline void appendEscaped(std::string& out, char ch) {
+    switch (ch) {
+    case '"':
+        out += "\\\"";
+        break;
+    case '\\':
+        out += "\\\\";
+        break;
+    case '\n':
+        out += "\\n";
+        break;
+    case '\r':
+        out += "\\r";
+        break;
+    case '\t':
+        out += "\\t";
+        break;
+    default:
+        if (static_cast<unsigned char>(ch) < 0x20) {
+            constexpr std::string_view hex = "0123456789abcdef";
+            out += "\\u00";
+            out += hex[static_cast<unsigned char>(ch) >> 4];
+            out += hex[static_cast<unsigned char>(ch) & 0xF];
+        } else {
+            out += ch;
+        }
+    }
+}
+
+inline void appendEscaped(std::string& out, std::string_view text) {
+    // Runs that don't need escaping are appended in one go
+    size_t start = 0;
+    for (size_t i = 0; i < text.size(); ++i) {
+        auto ch = static_cast<unsigned char>(text[i]);
+        if (ch < 0x20 || ch == '"' || ch == '\\') {
+            out.append(text.substr(start, i - start));
+            appendEscaped(out, text[i]);
+            start = i + 1;
+        }
+    }
+    out.append(text.substr(start));
+}
+
+/**
+ * Output iterator that escapes everything written through it, so values can be formatted straight into a quoted
+ * string without a temporary.
+ */
+class EscapingAppender {
+private:
+    std::string* out = nullptr;
+
+public:
+    using difference_type = std::ptrdiff_t;
+
+    EscapingAppender() = default;
+    explicit EscapingAppender(std::string& out) : out(&out) {}
+
+    EscapingAppender& operator=(char ch) {
+        appendEscaped(*out, ch);
+        return *this;
+    }
+    EscapingAppender& operator*() {
+        return *this;
+    }
+    EscapingAppender& operator++() {
+        return *this;
+    }
+    EscapingAppender operator++(int) {
+        return *this;
+    }
+};
+
+/**
+ * Writes everything up to the message, including the opening quote in the machine-readable formats.
+ */
+template <Level level>
+inline void beginRecord(std::string& out, bool colour, RecordFormat format, std::chrono::system_clock::time_point time) {
+    if (format == RecordFormat::TEXT) {
+        thread_local TimestampCache cache;
+        if (colour) {
+            constexpr const auto& seq = stc::colour::_detail::sgr<char, static_cast<int>(levelColour<level>())>;
+            out.append(seq.data.data(), seq.size);
+        }
+        out += cache.render(time);
+        out += " | ";
+        out += levelToPaddedString<level>();
+        out += " | ";
+    } else {
+        thread_local DateTimeCache cache;
+        bool json = format == RecordFormat::JSON;
+        out += json ? "{\"time\":\"" : "time=";
+        out += cache.render(time);
+        out += json ? "\",\"level\":\"" : " level=";
+        out += levelToString<level>();
+        out += json ? "\",\"msg\":\"" : " msg=\"";
+    }
+}
+
+inline void endMessage(std::string& out, RecordFormat format) {
+    if (format != RecordFormat::TEXT) {
+        out += '"';
+    }
+}
+
+inline void endRecord(std::string& out, bool colour, RecordFormat format) {
+    if (format == RecordFormat::JSON) {
+        out += '}';
+    }
+    out += '\n';
+    if (colour && format == RecordFormat::TEXT) {
+        out += "\033[0m";
+    }
+}
+
+/**
+ * Appends a formatted message. Machine-readable formats escape it, as it's inside a quoted string.
+ */
+template <class... Args>
+inline void writeMessage(std::string& out, RecordFormat format, const std::format_string<Args...>& fmt, Args&&... args) {
+    if (format == RecordFormat::TEXT) {
+        std::format_to(std::back_inserter(out), fmt, std::forward<Args>(args)...);
+    } else {
+        std::format_to(EscapingAppender(out), fmt, std::forward<Args>(args)...);
+    }
+}
+
+/**
+ * \returns whether or not a logfmt value needs to be quoted. Escaped values always do, as the escapes are only
+ *          meaningful inside quotes.
+ */
+inline bool needsQuotes(std::string_view value) {
+    if (value.empty()) {
+        return true;
+    }
+    for (char ch : value) {
+        if (static_cast<unsigned char>(ch) <= ' ' || ch == '=' || ch == '"' || ch == '\\') {
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * Appends a field value. Numbers are written with to_chars, strings are escaped as they're appended, and anything
+ * else is formatted straight into `out` with its std::formatter.
+ */
+template <typename T>
+inline void writeValue(std::string& out, RecordFormat format, const T& value) {
+    if constexpr (std::is_same_v<T, bool>) {
+        out += value ? "true" : "false";
+    } else if constexpr (std::is_arithmetic_v<T> && !std::is_same_v<T, char>) {
+        if constexpr (std::is_floating_point_v<T>) {
+            if (format == RecordFormat::JSON && !std::isfinite(value)) {
+                // JSON has no way to represent these as numbers
+                out += "null";
+                return;
+            }
+        }
+        std::array<char, 64> buffer;
+        auto result = std::to_chars(buffer.data(), buffer.data() + buffer.size(), value);
+        out.append(buffer.data(), result.ptr);
+    } else {
+        bool json = format == RecordFormat::JSON;
+        if (json) {
+            out += '"';
+        }
+        size_t start = out.size();
+        if constexpr (std::is_convertible_v<const T&, std::string_view>) {
+            appendEscaped(out, std::string_view(value));
+        } else {
+            std::format_to(EscapingAppender(out), "{}", value);
+        }
+        if (json) {
+            out += '"';
+        } else if (needsQuotes(std::string_view(out).substr(start))) {
+            // Quoting is decided after the fact, so the value is only formatted once. The insert doesn't allocate
+            // once the record buffer has grown to fit.
+            out.insert(out.begin() + static_cast<std::ptrdiff_t>(start), '"');
+            out += '"';
+        }
+    }
+}
+
+template <typename T>
+inline void writeField(std::string& out, RecordFormat format, const KV<T>& field) {
+    if (format == RecordFormat::JSON) {
+        out += ",\"";
+        appendEscaped(out, field.key);
+        out += "\":";
+    } else {
+        out += ' ';
+        out += field.key;
+        out += '=';
+    }
+    writeValue(out, format, field.value);
+}
+
+/**
+ * Appends a full structured record to `out`. In TEXT, the fields are appended to the message in logfmt style.
+ */
+template <Level level, typename... Ts>
+inline void formatKVRecordTo(std::string& out, bool colour, std::string_view message, const KV<Ts>&... fields) {
+    auto format = config().format.load(std::memory_order_relaxed);
+    colour = colour && format == RecordFormat::TEXT;
+    beginRecord<level>(out, colour, format, std::chrono::system_clock::now());
+    if (format == RecordFormat::TEXT) {
+        out += message;
+    } else {
+        appendEscaped(out, message);
+    }
+    endMessage(out, format);
+    (writeField(out, format, fields), ...);
+    endRecord(out, colour, format);
+}
+
+/**
+ * Appends a full record to `out`. Everything but the message is a plain append, and the message is formatted straight
+ * into `out`, so no temporary strings are created.
+ */
+template <Level level, class... Args>
+inline void formatRecordTo(std::string& out, bool colour, const std::format_string<Args...>& fmt, Args&&... args) {
+    auto format = config().format.load(std::memory_order_relaxed);
+    colour = colour && format == RecordFormat::TEXT;
+    beginRecord<level>(out, colour, format, std::chrono::system_clock::now());
+    writeMessage<Args...>(out, format, fmt, std::forward<Args>(args)...);
+    endMessage(out, format);
+    endRecord(out, colour, format);
+}
+
+/**
+ * \returns the calling thread's record buffer. It's reused for every record, so it only allocates when a record is
+ *          larger than any previous record on the thread.
+ */
+inline std::string& recordBuffer() {
+    thread_local std::string buffer;
+    buffer.clear();
+    return buffer;
+}
+
+/**
+ * Formats a full record into a new string, sized to fit.
+ */
+template <Level level, class... Args>
+inline std::string formatRecord(bool colour, const std::format_string<Args...>& fmt, Args&&... args) {
+    auto& buffer = recordBuffer();
+    formatRecordTo<level, Args...>(buffer, colour, fmt, std::forward<Args>(args)...);
+    return buffer;
+}
+
+/**
+ * \returns whether or not synchronous records should be coloured, resolving Config::colour if it hasn't been yet.
+ */
+inline bool useColour() {
+    auto colour = config().colour.load(std::memory_order_relaxed);
+    if (colour == -1) {
+        // If several threads get here at once, they all come to the same conclusion, so the race doesn't matter
+        colour = isFdTTY(config().fd.load(std::memory_order_relaxed))
+            && stc::colour::getTerminalColourDepth() != stc::colour::ColourDepth::NONE;
+        config().colour.store(colour, std::memory_order_relaxed);
+    }
+    return colour == 1;
+}
+
+#ifndef _WIN32
+/**
+ * One file written by a FileSink. Producers claim a range of the segment with a fetch_add on `reserved`, so they never
+ * wait for each other. `active` counts the producers that may be writing to the segment, which is what lets a rotated
+ * segment be closed without the write path taking a lock.
+ */
+struct FileSegment {
+    std::string path;
+    int fd = -1;
+    /**
+     * The mapping, or nullptr if records are written with pwrite().
+     */
+    char* map = nullptr;
+    size_t capacity = 0;
+    /**
+     * When the segment became the current segment. Guarded by FileSink::rotateLock.
+     */
+    std::chrono::steady_clock::time_point started;
+
+    alignas(64) std::atomic<size_t> reserved = 0;
+    /**
+     * The start of the first reservation that didn't fit. Reservations only grow, so this is where the data ends.
+     */
+    std::atomic<size_t> overflow = SIZE_MAX;
+    alignas(64) std::atomic<size_t> active = 0;
+};
+
+/**
+ * Appends records to a series of preallocated files. A background thread keeps a standby segment opened and
+ * preallocated ahead of time, so rotating is a pointer swap under a lock. The same thread closes rotated segments,
+ * rotates by time, and syncs the current segment to disk.
+ */
+class FileSink {
+private:
+    /**
+     * How long to wait before retrying a time-based rotation that failed.
+     */
+    static constexpr auto rotateRetryDelay = std::chrono::seconds(1);
+
+    FileSinkConfig config;
+
+    std::atomic<FileSegment*> current = nullptr;
+    std::atomic<size_t> nextIndex = 0;
+
+    std::mutex rotateLock;
+    std::condition_variable standbyNotifier;
+    FileSegment* standby = nullptr;
+    /**
+     * Whether the background thread is opening a new standby segment.
+     */
+    bool opening = false;
+    /**
+     * Segments that have been rotated out, but not closed yet.
+     */
+    std::vector<FileSegment*> retired;
+    /**
+     * Every segment that has been opened. Closed segments are kept, as a producer may still be about to look at their
+     * `active` count.
+     */
+    std::vector<std::unique_ptr<FileSegment>> segments;
+
+    std::mutex wakeLock;
+    std::condition_variable wakeNotifier;
+    bool stopping = false;
+    bool wakeRequested = false;
+
+    std::thread thread;
+
+    /**
+     * \returns false if the data couldn't be written in full, because the disk is full for instance.
+     */
+    static bool pwriteAll(int fd, std::string_view data, size_t offset) {
+        while (!data.empty()) {
+            auto written = ::pwrite(fd, data.data(), data.size(), static_cast<off_t>(offset));
+            if (written <= 0) {
+                if (written < 0 && errno == EINTR) {
+                    continue;
+                }
+                return false;
+            }
+            data.remove_prefix(static_cast<size_t>(written));
+            offset += static_cast<size_t>(written);
+        }
+        return true;
+    }
+
+    static void syncData(int fd) {
+#ifdef __linux__
+        ::fdatasync(fd);
+#else
+        ::fsync(fd);
+#endif
+    }
+
+    /**
+     * Reserves disk space for a segment.
+     *
+     * \returns whether the space was reserved. If not, errno is EOPNOTSUPP if the filesystem (or OS) can't
+     *          preallocate, which isn't an error.
+     */
+    bool preallocate(int fd, size_t size) const {
+#ifdef __linux__
+        // Without a mapping, the file size is left alone, so readers only ever see what's been written
+        int mode = config.useMmap ? 0 : FALLOC_FL_KEEP_SIZE;
+        return ::fallocate(fd, mode, 0, static_cast<off_t>(size)) == 0;
+#else
+        (void) fd;
+        (void) size;
+        errno = EOPNOTSUPP;
+        return false;
+#endif
+    }
+
+    /**
+     * Opens and preallocates the next segment.
+     *
+     * \throws std::runtime_error if the segment can't be created, preallocated, or mapped.
+     */
+    std::unique_ptr<FileSegment> openSegment(size_t capacity) {
+        auto segment = std::make_unique<FileSegment>();
+        segment->capacity = capacity;
+        size_t index;
+        while (true) {
+            index = nextIndex.fetch_add(1, std::memory_order_relaxed);
+            auto number = std::to_string(index);
+            segment->path = config.path + "." + std::string(number.size() < 6 ? 6 - number.size() : 0, '0') + number;
+            segment->fd = ::open(
+                segment->path.c_str(),
+                (config.useMmap ? O_RDWR : O_WRONLY) | O_CREAT | O_EXCL | O_CLOEXEC,
+                0644
+            );
+            if (segment->fd >= 0) {
+                break;
+            }
+            if (errno != EEXIST) {
+                releaseIndex(index);
+                throw std::runtime_error("Failed to create log segment " + segment->path);
+            }
+        }
+
+        bool reserved = preallocate(segment->fd, capacity);
+        if (!reserved && errno != EOPNOTSUPP) {
+            discard(*segment);
+            releaseIndex(index);
+            throw std::runtime_error("Failed to preallocate log segment " + segment->path);
+        }
+        // Writing to a mapping of a sparse file raises SIGBUS if the disk fills up, so segments that couldn't be
+        // preallocated are written with pwrite(), which fails like any other write
+        if (config.useMmap && reserved) {
+            void* map = ::mmap(nullptr, capacity, PROT_READ | PROT_WRITE, MAP_SHARED, segment->fd, 0);
+            if (map == MAP_FAILED) {
+                discard(*segment);
+                releaseIndex(index);
+                throw std::runtime_error("Failed to map log segment " + segment->path);
+            }
+            segment->map = static_cast<char*>(map);
+        }
+        return segment;
+    }
+
+    /**
+     * Hands back the number of a segment that failed to open, so repeated failures (a full disk, for instance) don't
+     * leave gaps in the numbering. If another segment has claimed a later number in the meanwhile, the gap stays.
+     */
+    void releaseIndex(size_t index) {
+        size_t expected = index + 1;
+        nextIndex.compare_exchange_strong(expected, index, std::memory_order_relaxed);
+    }
+
+    /**
+     * Closes and deletes a segment that was never written to.
+     */
+    static void discard(FileSegment& segment) {
+        if (segment.map != nullptr) {
+            ::munmap(segment.map, segment.capacity);
+            segment.map = nullptr;
+        }
+        ::close(segment.fd);
+        segment.fd = -1;
+        ::unlink(segment.path.c_str());
+    }
+
+    static size_t used(const FileSegment& segment) {
+        return std::min(
+            segment.reserved.load(std::memory_order_relaxed),
+            segment.overflow.load(std::memory_order_relaxed)
+        );
+    }
+
+    static void sync(FileSegment& segment) {
+        if (segment.map != nullptr) {
+            ::msync(segment.map, used(segment), MS_SYNC);
+        }
+        syncData(segment.fd);
+    }
+
+    /**
+     * Waits for the last writers of a rotated segment, trims off the unused preallocated space, syncs it, and closes it.
+     */
+    static void close(FileSegment& segment) {
+        // seq_cst, to pair with the increment and re-check in write(). Once this is 0, anyone else who gets hold of
+        // the segment sees that it's no longer current, and backs off without writing to it.
+        while (segment.active.load() != 0) {
+            std::this_thread::yield();
+        }
+        auto end = used(segment);
+        if (segment.map != nullptr) {
+            ::msync(segment.map, end, MS_SYNC);
+            ::munmap(segment.map, segment.capacity);
+            segment.map = nullptr;
+        }
+        if (::ftruncate(segment.fd, static_cast<off_t>(end)) == 0) {
+            ::fsync(segment.fd);
+        }
+        ::close(segment.fd);
+        segment.fd = -1;
+    }
+
+    void wake() {
+        {
+            std::lock_guard l(wakeLock);
+            wakeRequested = true;
+        }
+        wakeNotifier.notify_one();
+    }
+
+    /**
+     * Swaps `full` out for the standby segment, if it's still the current segment. Unless the standby hasn't been
+     * opened yet, or the record doesn't fit in it, the lock is only held for the swap.
+     *
+     * \returns false if a new segment was needed, but couldn't be opened.
+     */
+    bool rotate(FileSegment* full, size_t needed) {
+        {
+            std::unique_lock l(rotateLock);
+            // Segments have to be used in the order they're numbered, so a standby that's being opened can't be
+            // skipped
+            standbyNotifier.wait(l, [this]() { return !opening; });
+            if (current.load(std::memory_order_relaxed) != full) {
+                return true;
+            }
+            FileSegment* next = std::exchange(standby, nullptr);
+            if (next != nullptr && next->capacity < needed) {
+                discard(*next);
+                next = nullptr;
+            }
+            if (next == nullptr) {
+                try {
+                    next = segments.emplace_back(openSegment(std::max(config.segmentSize, needed))).get();
+                } catch (const std::runtime_error&) {
+                    return false;
+                }
+            }
+            next->started = std::chrono::steady_clock::now();
+            current.store(next);
+            retired.push_back(full);
+        }
+        wake();
+        return true;
+    }
+
+    void run() {
+        auto nextSync = std::chrono::steady_clock::now() + config.fsyncInterval;
+        auto rotateRetry = std::chrono::steady_clock::time_point::min();
+        FileSegment* synced = nullptr;
+        size_t syncedSize = 0;
+
+        while (true) {
+            {
+                std::lock_guard l(wakeLock);
+                if (stopping) {
+                    // stop() takes care of everything that's left
+                    return;
+                }
+                wakeRequested = false;
+            }
+
+            {
+                std::unique_lock l(rotateLock);
+                if (standby == nullptr) {
+                    // Opened outside the lock, so producers can keep writing, and only wait if they need to rotate
+                    // before it's done
+                    opening = true;
+                    l.unlock();
+                    std::unique_ptr<FileSegment> segment;
+                    try {
+                        segment = openSegment(config.segmentSize);
+                    } catch (const std::runtime_error&) {
+                        // Tried again on the next wakeup. rotate() opens its own segment if it has to.
+                    }
+                    l.lock();
+                    if (segment != nullptr) {
+                        standby = segments.emplace_back(std::move(segment)).get();
+                    }
+                    opening = false;
+                    standbyNotifier.notify_all();
+                }
+            }
+
+            std::vector<FileSegment*> closing;
+            {
+                std::lock_guard l(rotateLock);
+                closing.swap(retired);
+            }
+            for (auto* segment : closing) {
+                close(*segment);
+            }
+
+            // Only this thread and stop() close segments, and stop() joins this thread first, so the current segment
+            // stays open until the end of the iteration even if it's rotated
+            auto* segment = current.load(std::memory_order_acquire);
+            auto now = std::chrono::steady_clock::now();
+            auto deadline = std::chrono::steady_clock::time_point::max();
+
+            if (config.rotateInterval.count() > 0) {
+                std::unique_lock l(rotateLock);
+                if (now - segment->started >= config.rotateInterval && now >= rotateRetry) {
+                    if (segment->reserved.load(std::memory_order_relaxed) != 0) {
+                        l.unlock();
+                        if (rotate(segment, 0)) {
+                            continue;
+                        }
+                        // Most likely out of disk space. The current segment keeps being used, and the rotation is
+                        // retried after a delay rather than in a tight loop.
+                        rotateRetry = now + rotateRetryDelay;
+                        l.lock();
+                    } else {
+                        // Rotating an empty segment would just litter the directory with empty files
+                        segment->started = now;
+                    }
+                }
+                deadline = std::max(segment->started + config.rotateInterval, rotateRetry);
+            }
+
+            if (config.fsyncInterval.count() > 0) {
+                if (now >= nextSync) {
+                    auto size = used(*segment);
+                    if (segment != synced || size != syncedSize) {
+                        sync(*segment);
+                        synced = segment;
+                        syncedSize = size;
+                    }
+                    nextSync = now + config.fsyncInterval;
+                }
+                deadline = std::min(deadline, nextSync);
+            }
+
+            std::unique_lock l(wakeLock);
+            auto woken = [this]() { return stopping || wakeRequested; };
+            if (deadline == std::chrono::steady_clock::time_point::max()) {
+                wakeNotifier.wait(l, woken);
+            } else {
+                wakeNotifier.wait_until(l, deadline, woken);
+            }
+        }
+    }
+
+public:
+    /**
+     * \throws std::runtime_error if the config is invalid, or the first segment can't be opened.
+     */
+    FileSink(const FileSinkConfig& config) : config(config) {
+        if (config.path.empty()) {
+            throw std::runtime_error("The file sink needs a path");
+        }
+        if (config.segmentSize == 0) {
+            throw std::runtime_error("The file sink's segment size must be non-zero");
+        }
+        auto* first = segments.emplace_back(openSegment(config.segmentSize)).get();
+        first->started = std::chrono::steady_clock::now();
+        current.store(first);
+        thread = std::thread(&FileSink::run, this);
+    }
+
+    ~FileSink() {
+        stop();
+    }
+
+    bool isColour() const {
+        return config.colour;
+    }
+
+    /**
+     * Appends data to the current segment, rotating it if the data doesn't fit.
+     *
+     * \returns false if the sink has been stopped, if a new segment was needed but couldn't be opened, or if the
+     *          data couldn't be written to the segment. The caller should write the data somewhere else.
+     */
+    bool write(std::string_view data) {
+        if (data.empty()) {
+            return true;
+        }
+        while (true) {
+            auto* segment = current.load(std::memory_order_acquire);
+            if (segment == nullptr) {
+                return false;
+            }
+            // seq_cst for both, to pair with the swap in rotate() and the wait in close(); either close() sees this
+            // writer, or this writer sees that the segment has been rotated
+            segment->active.fetch_add(1);
+            if (current.load() != segment) {
+                segment->active.fetch_sub(1, std::memory_order_release);
+                continue;
+            }
+
+            size_t start = segment->reserved.fetch_add(data.size(), std::memory_order_relaxed);
+            if (start + data.size() <= segment->capacity) {
+                bool written = true;
+                if (segment->map != nullptr) {
+                    std::memcpy(segment->map + start, data.data(), data.size());
+                } else {
+                    written = pwriteAll(segment->fd, data, start);
+                }
+                segment->active.fetch_sub(1, std::memory_order_release);
+                return written;
+            }
+
+            size_t overflow = segment->overflow.load(std::memory_order_relaxed);
+            while (start < overflow
+                   && !segment->overflow.compare_exchange_weak(overflow, start, std::memory_order_relaxed)) {}
+            segment->active.fetch_sub(1, std::memory_order_release);
+            if (!rotate(segment, data.size())) {
+                return false;
+            }
+        }
+    }
+
+    /**
+     * Stops the background thread, and closes every segment. Writes after this return false.
+     */
+    void stop() {
+        if (!thread.joinable()) {
+            return;
+        }
+        {
+            std::lock_guard l(wakeLock);
+            stopping = true;
+        }
+        wakeNotifier.notify_one();
+        thread.join();
+
+        std::lock_guard l(rotateLock);
+        if (auto* segment = current.exchange(nullptr); segment != nullptr) {
+            retired.push_back(segment);
+        }
+        for (auto* segment : retired) {
+            close(*segment);
+        }
+        retired.clear();
+        if (standby != nullptr) {
+            discard(*standby);
+            standby = nullptr;
+        }
+    }
+};
+
+struct FileSinkState {
+    std::atomic<FileSink*> current = nullptr;
+
+    std::mutex lock;
+    std::vector<std::unique_ptr<FileSink>> sinks;
+
+    ~FileSinkState() {
+        // Anything that still logs after this point goes to the fd, rather than to a sink that's about to be freed
+        current.store(nullptr);
+    }
+};
+
+// Like configInstance, the mode states are inline variables rather than function-local statics, as every record
+// checks them, and a guard check per record adds up.
+//
+// The order they're defined in matters: they're destroyed in reverse, so the async and binary writers do their final
+// drain at exit while the file sink is still around.
+inline FileSinkState fileSinkInstance;
+#endif
+
+/**
+ * Writes records to the file sink if one is running, and to the fd otherwise. If the sink can't take the records, they
+ * go to the fd as well, so nothing is lost.
+ */
+inline void writeOutput(int fd, std::string_view data) {
+#ifndef _WIN32
+    if (auto* sink = fileSinkInstance.current.load(std::memory_order_acquire); sink != nullptr && sink->write(data)) {
+        return;
+    }
+#endif
+    writeAll(fd, data);
+}
+
+/**
+ * \returns whether or not records should be coloured, given whether they'd be coloured if written to the fd.
+ */
+inline bool outputColour(bool fdColour) {
+#ifndef _WIN32
+    if (auto* sink = fileSinkInstance.current.load(std::memory_order_acquire); sink != nullptr) {
+        return sink->isColour();
+    }
+#endif
+    return fdColour;
+}
+
+/**
+ * Bounded lock-free multi-producer, single-consumer queue of records. Each slot has a sequence number that says
+ * whether it's free for the producer at a given position, or ready for the consumer; producers claim positions with a
+ * CAS on the tail, so they only contend with each other on a single cache line.
+ *
+ * \see https://www.1024cores.net/home/lock-free-algorithms/queues/bounded-mpmc-queue
+ */
+class RecordQueue {
+private:
+    struct Slot {
+        std::atomic<size_t> sequence;
+        std::string record;
+    };
+
+    std::unique_ptr<Slot[]> slots;
+    size_t mask;
+
+    alignas(64) std::atomic<size_t> tail = 0;
+    // Only touched by the consumer
+    alignas(64) size_t head = 0;
+
+public:
+    RecordQueue(size_t capacity) {
+        size_t size = 1;
+        while (size < capacity) {
+            size <<= 1;
+        }
+        slots = std::make_unique<Slot[]>(size);
+        mask = size - 1;
+        for (size_t i = 0; i < size; ++i) {
+            slots[i].sequence.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    /**
+     * Moves the record into the queue.
+     *
+     * \returns false if the queue is full, in which case the record is left untouched.
+     */
+    bool tryPush(std::string& record) {
+        size_t pos = tail.load(std::memory_order_relaxed);
+        while (true) {
+            auto& slot = slots[pos & mask];
+            size_t sequence = slot.sequence.load(std::memory_order_acquire);
+            auto diff = static_cast<std::ptrdiff_t>(sequence) - static_cast<std::ptrdiff_t>(pos);
+            if (diff == 0) {
+                if (tail.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    slot.record = std::move(record);
+                    slot.sequence.store(pos + 1, std::memory_order_release);
+                    return true;
+                }
+                // pos was updated by the failed CAS
+            } else if (diff < 0) {
+                return false;
+            } else {
+                pos = tail.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    /**
+     * Moves the oldest record into `out`. Must only be called from the consumer thread.
+     *
+     * \returns false if the queue is empty.
+     */
+    bool tryPop(std::string& out) {
+        auto& slot = slots[head & mask];
+        if (slot.sequence.load(std::memory_order_acquire) != head + 1) {
+            return false;
+        }
+        out = std::move(slot.record);
+        slot.record = {};
+        slot.sequence.store(head + mask + 1, std::memory_order_release);
+        ++head;
+        return true;
+    }
+
+    bool empty() const {
+        return slots[head & mask].sequence.load(std::memory_order_acquire) != head + 1;
+    }
+
+    /**
+     * \returns the number of positions claimed by producers so far. Includes records that are still being moved into
+     *          their slot.
+     */
+    size_t claimed() const {
+        return tail.load(std::memory_order_acquire);
+    }
+
+    /**
+     * \returns the number of records popped so far. Must only be called from the consumer thread.
+     */
+    size_t consumed() const {
+        return head;
+    }
+};
+
+/**
+ * Background writer used by async mode. Records are formatted by the logging threads, and pushed to a RecordQueue. The
+ * writer thread concatenates everything that's queued up into a single buffer, and writes it with one write().
+ */
+class AsyncWriter {
+private:
+    static constexpr size_t batchSize = 1 << 16;
+
+    AsyncConfig config;
+    bool colour;
+    RecordQueue queue;
+
+    std::atomic<bool> sleeping = false;
+    std::atomic<bool> stopping = false;
+
+    /**
+     * The queue position everything before has been written up to. Compared against RecordQueue::claimed() by flush().
+     */
+    std::atomic<size_t> written = 0;
+    std::atomic<size_t> dropped = 0;
+
+    std::thread thread;
+
+    void wake() {
+        // Pairs with the fence in run(); either the writer sees the new record, or this sees that it's sleeping.
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (sleeping.load(std::memory_order_relaxed) && sleeping.exchange(false)) {
+            sleeping.notify_one();
+        }
+    }
+
+    void run() {
+        std::string batch;
+        batch.reserve(batchSize);
+        std::string record;
+        size_t reportedDrops = 0;
+
+        while (true) {
+            while (batch.size() < batchSize && queue.tryPop(record)) {
+                batch += record;
+            }
+            if (config.overflow == OverflowPolicy::COUNT) {
+                auto drops = dropped.load(std::memory_order_relaxed);
+                if (drops != reportedDrops) {
+                    batch += std::format("minilog: dropped {} records\n", drops - reportedDrops);
+                    reportedDrops = drops;
+                }
+            }
+
+            if (!batch.empty()) {
+                writeOutput(config.fd, batch);
+                batch.clear();
+                written.store(queue.consumed(), std::memory_order_release);
+                written.notify_all();
+                continue;
+            }
+
+            if (stopping.load(std::memory_order_acquire)) {
+                return;
+            }
+
+            sleeping.store(true);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            if (queue.empty() && !stopping.load(std::memory_order_acquire)) {
+                sleeping.wait(true);
+            }
+            sleeping.store(false, std::memory_order_relaxed);
+        }
+    }
+
+public:
+    AsyncWriter(const AsyncConfig& config)
+        : config(config),
+          colour(config.colour.value_or(
+              isFdTTY(config.fd) && stc::colour::getTerminalColourDepth() != stc::colour::ColourDepth::NONE
+          )),
+          queue(config.capacity) {
+        thread = std::thread(&AsyncWriter::run, this);
+    }
+
+    ~AsyncWriter() {
+        stop();
+    }
+
+    bool isColour() const {
+        return outputColour(colour);
+    }
+
+    void push(std::string&& record) {
+        while (!queue.tryPush(record)) {
+            if (config.overflow != OverflowPolicy::BLOCK) {
+                dropped.fetch_add(1, std::memory_order_relaxed);
+                // The writer may have stopped at a full queue, and needs to report the drop
+                wake();
+                return;
+            }
+            wake();
+            std::this_thread::yield();
+        }
+        wake();
+    }
+
+    /**
+     * Blocks until everything pushed before the call has been written. The target is the queue's tail rather than a
+     * separate counter, so a push that has claimed its position is always covered, even if it hasn't finished yet.
+     */
+    void flush() {
+        auto target = queue.claimed();
+        auto current = written.load(std::memory_order_acquire);
+        while (current < target) {
+            written.wait(current, std::memory_order_acquire);
+            current = written.load(std::memory_order_acquire);
+        }
+    }
+
+    /**
+     * Writes everything that's been queued up, and stops the writer thread.
+     */
+    void stop() {
+        if (!thread.joinable()) {
+            return;
+        }
+        stopping.store(true, std::memory_order_release);
+        sleeping.store(false);
+        sleeping.notify_one();
+        thread.join();
+    }
+
+    size_t getDroppedCount() const {
+        return dropped.load(std::memory_order_relaxed);
+    }
+};
+
+struct AsyncState {
+    std::atomic<AsyncWriter*> current = nullptr;
+
+    std::mutex lock;
+    /**
+     * Every writer that has been started. Stopped writers are kept alive, as a logging thread may still hold a pointer
+     * to one. See EnvSnapshot for the same trick.
+     */
+    std::vector<std::unique_ptr<AsyncWriter>> writers;
+};
+
+inline AsyncState asyncInstance;
+
+template <typename T>
+concept BinaryString = std::is_convertible_v<const T&, std::string_view>;
+
+template <typename T>
+concept BinaryEncodable = BinaryString<std::remove_cvref_t<T>>
+    || (std::is_trivially_copyable_v<std::remove_cvref_t<T>> && isBinarySafe<std::remove_cvref_t<T>>);
+
+/**
+ * The type an argument is decoded as. Strings are stored as a length and the characters, and come back out as
+ * string_views into the record.
+ */
+template <typename T>
+using BinaryStored = std::conditional_t<BinaryString<std::remove_cvref_t<T>>, std::string_view, std::remove_cvref_t<T>>;
+
+/**
+ * Writes the formatted record for a binary record's payload to `out`.
+ */
+using BinaryDecoder = void (*)(
+    bool colour,
+    std::string_view fmt,
+    std::chrono::system_clock::time_point time,
+    const char* payload,
+    std::string& out
+);
+
+/**
+ * Header of a record in a BinaryRing. The decoder and format string together identify the callsite; neither is copied,
+ * as they're both static for the lifetime of the program.
+ */
+struct BinaryRecordHeader {
+    /**
+     * nullptr for the padding record used to skip the end of the ring.
+     */
+    BinaryDecoder decode;
+    const char* fmt;
+    uint32_t fmtSize;
+    uint32_t size;
+    int64_t time;
+};
+
+template <typename T>
+inline size_t binaryArgSize(const T& arg) {
+    if constexpr (BinaryString<T>) {
+        return sizeof(uint32_t) + std::string_view(arg).size();
+    } else {
+        return sizeof(T);
+    }
+}
+
+template <typename T>
+inline char* writeBinaryArg(char* out, const T& arg) {
+    if constexpr (BinaryString<T>) {
+        std::string_view view(arg);
+        auto size = static_cast<uint32_t>(view.size());
+        std::memcpy(out, &size, sizeof(size));
+        std::memcpy(out + sizeof(size), view.data(), view.size());
+        return out + sizeof(size) + view.size();
+    } else {
+        std::memcpy(out, &arg, sizeof(T));
+        return out + sizeof(T);
+    }
+}
+
+template <typename Stored>
+inline Stored readBinaryArg(const char*& in) {
+    if constexpr (std::is_same_v<Stored, std::string_view>) {
+        uint32_t size;
+        std::memcpy(&size, in, sizeof(size));
+        std::string_view out(in + sizeof(size), size);
+        in += sizeof(size) + size;
+        return out;
+    } else {
+        Stored out;
+        std::memcpy(&out, in, sizeof(Stored));
+        in += sizeof(Stored);
+        return out;
+    }
+}
+
+template <Level level, typename... Stored>
+inline void decodeBinaryRecord(
+    bool colour,
+    std::string_view fmt,
+    std::chrono::system_clock::time_point time,
+    [[maybe_unused]] const char* payload,
+    std::string& out
+) {
+    auto format = config().format.load(std::memory_order_relaxed);
+    colour = colour && format == RecordFormat::TEXT;
+    beginRecord<level>(out, colour, format, time);
+    // Braced initialisation guarantees left-to-right evaluation, so the arguments are read in order
+    std::tuple<Stored...> values { readBinaryArg<Stored>(payload)... };
+    std::apply([&](Stored&... args) {
+        if (format == RecordFormat::TEXT) {
+            std::vformat_to(std::back_inserter(out), fmt, std::make_format_args(args...));
+        } else {
+            std::vformat_to(EscapingAppender(out), fmt, std::make_format_args(args...));
+        }
+    }, values);
+    endMessage(out, format);
+    endRecord(out, colour, format);
+}
+
+/**
+ * Decoder for records that were formatted by the logging thread, because some argument couldn't be stored in binary.
+ */
+inline void decodeTextRecord(
+    bool,
+    std::string_view,
+    std::chrono::system_clock::time_point,
+    const char* payload,
+    std::string& out
+) {
+    out += readBinaryArg<std::string_view>(payload);
+}
+
+/**
+ * Single-producer, single-consumer byte ring buffer, holding one thread's binary records. Records are never split
+ * across the end of the buffer; if a record doesn't fit in the space left before the end, that space is skipped.
+ */
+class BinaryRing {
+private:
+    std::unique_ptr<char[]> data;
+    size_t capacity;
+
+    alignas(64) std::atomic<size_t> tail = 0;
+    alignas(64) std::atomic<size_t> head = 0;
+    std::atomic<size_t> dropped = 0;
+
+public:
+    /**
+     * Set when the owning thread exits. The consumer removes the ring once it's been drained.
+     */
+    std::atomic<bool> orphaned = false;
+
+    static constexpr size_t alignment = alignof(BinaryRecordHeader);
+
+    BinaryRing(size_t requested) {
+        capacity = 256;
+        while (capacity < requested) {
+            capacity <<= 1;
+        }
+        data = std::make_unique<char[]>(capacity);
+    }
+
+    /**
+     * Reserves `size` bytes, calls fill with a pointer to them, and publishes the record. Only called by the owning
+     * thread.
+     *
+     * \returns false if the record didn't fit, in which case it's counted as dropped.
+     */
+    template <typename F>
+    bool write(size_t size, F&& fill) {
+        size = (size + alignment - 1) & ~(alignment - 1);
+        size_t pos = tail.load(std::memory_order_relaxed);
+        size_t offset = pos & (capacity - 1);
+        size_t contiguous = capacity - offset;
+        size_t needed = contiguous < size ? contiguous + size : size;
+
+        if (needed > capacity - (pos - head.load(std::memory_order_acquire))) {
+            dropped.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+        if (contiguous < size) {
+            if (contiguous >= sizeof(BinaryRecordHeader)) {
+                BinaryRecordHeader padding {};
+                std::memcpy(data.get() + offset, &padding, sizeof(padding));
+            }
+            pos += contiguous;
+            offset = 0;
+        }
+        fill(data.get() + offset);
+        tail.store(pos + size, std::memory_order_release);
+        return true;
+    }
+
+    /**
+     * Calls f with each complete record, then releases them. Only called by the consumer.
+     */
+    template <typename F>
+    void drain(F&& f) {
+        size_t pos = head.load(std::memory_order_relaxed);
+        size_t end = tail.load(std::memory_order_acquire);
+        while (pos < end) {
+            size_t offset = pos & (capacity - 1);
+            size_t contiguous = capacity - offset;
+            if (contiguous < sizeof(BinaryRecordHeader)) {
+                pos += contiguous;
+                continue;
+            }
+            BinaryRecordHeader header;
+            std::memcpy(&header, data.get() + offset, sizeof(header));
+            if (header.decode == nullptr) {
+                pos += contiguous;
+                continue;
+            }
+            f(header, data.get() + offset + sizeof(header));
+            pos += (header.size + alignment - 1) & ~(alignment - 1);
+        }
+        head.store(pos, std::memory_order_release);
+    }
+
+    bool empty() const {
+        return head.load(std::memory_order_acquire) == tail.load(std::memory_order_acquire);
+    }
+
+    size_t getDroppedCount() const {
+        return dropped.load(std::memory_order_relaxed);
+    }
+};
+
+/**
+ * Consumer for binary mode. Each logging thread gets its own BinaryRing the first time it logs. The consumer thread
+ * periodically drains every ring, formats the records, orders them by time, and writes them with a single write().
+ */
+class BinaryWriter {
+private:
+    BinaryConfig config;
+    bool colour;
+
+    std::mutex ringsLock;
+    std::vector<std::shared_ptr<BinaryRing>> rings;
+    /**
+     * Drops from rings that have since been removed.
+     */
+    size_t retiredDrops = 0;
+    /**
+     * Copy of rings that the consumer drains, so ringsLock isn't held while formatting, and threads registering a new
+     * ring don't have to wait for it. Only used by the consumer thread.
+     */
+    std::vector<std::shared_ptr<BinaryRing>> draining;
+    /**
+     * The rings in draining that were orphaned before they were drained. Only used by the consumer thread.
+     */
+    std::vector<BinaryRing*> retiring;
+
+    std::mutex wakeLock;
+    std::condition_variable wakeNotifier;
+    bool stopping = false;
+    bool wakeRequested = false;
+    /**
+     * The number of completed passes, including ones that found nothing to write.
+     */
+    std::atomic<size_t> passes = 0;
+
+    std::thread thread;
+
+    struct Decoded {
+        int64_t time;
+        size_t offset;
+        size_t size;
+    };
+
+    /**
+     * Drains every ring once.
+     *
+     * \returns whether or not anything was written.
+     */
+    bool pass(std::string& text, std::string& out, std::vector<Decoded>& decoded, size_t& reportedDrops) {
+        text.clear();
+        out.clear();
+        decoded.clear();
+        retiring.clear();
+        bool colour = isColour();
+        {
+            std::lock_guard l(ringsLock);
+            draining.assign(rings.begin(), rings.end());
+        }
+        for (const auto& ring : draining) {
+            // Read before draining, so an orphaned ring is never removed before its last records are drained
+            if (ring->orphaned.load(std::memory_order_acquire)) {
+                retiring.push_back(ring.get());
+            }
+            ring->drain([&](const BinaryRecordHeader& header, const char* payload) {
+                size_t offset = text.size();
+                header.decode(
+                    colour,
+                    std::string_view(header.fmt, header.fmtSize),
+                    std::chrono::system_clock::time_point(std::chrono::system_clock::duration(header.time)),
+                    payload,
+                    text
+                );
+                decoded.push_back({ header.time, offset, text.size() - offset });
+            });
+        }
+        draining.clear();
+
+        size_t drops;
+        {
+            std::lock_guard l(ringsLock);
+            // Orphaned rings can't drop anything else, so their count is final
+            std::erase_if(rings, [&](const std::shared_ptr<BinaryRing>& ring) {
+                if (std::find(retiring.begin(), retiring.end(), ring.get()) == retiring.end()) {
+                    return false;
+                }
+                retiredDrops += ring->getDroppedCount();
+                return true;
+            });
+            drops = retiredDrops;
+            for (const auto& ring : rings) {
+                drops += ring->getDroppedCount();
+            }
+        }
+
+        // Records from a single ring are already in order, so a stable sort keeps them that way even if the clock
+        // misbehaves
+        std::stable_sort(decoded.begin(), decoded.end(), [](const Decoded& a, const Decoded& b) {
+            return a.time < b.time;
+        });
+        for (const auto& record : decoded) {
+            out.append(text, record.offset, record.size);
+        }
+        if (drops != reportedDrops) {
+            out += std::format("minilog: dropped {} records\n", drops - reportedDrops);
+            reportedDrops = drops;
+        }
+        if (out.empty()) {
+            return false;
+        }
+        writeOutput(config.fd, out);
+        return true;
+    }
+
+    void run() {
+        std::string text, out;
+        std::vector<Decoded> decoded;
+        size_t reportedDrops = 0;
+        while (true) {
+            bool stop;
+            {
+                std::lock_guard l(wakeLock);
+                stop = stopping;
+                wakeRequested = false;
+            }
+            bool wrote;
+            do {
+                wrote = pass(text, out, decoded, reportedDrops);
+                // Counted per pass, so a flush isn't held up by other threads that keep the consumer busy
+                passes.fetch_add(1, std::memory_order_release);
+                passes.notify_all();
+            } while (wrote);
+            if (stop) {
+                return;
+            }
+
+            std::unique_lock l(wakeLock);
+            wakeNotifier.wait_for(l, config.pollInterval, [this]() { return stopping || wakeRequested; });
+        }
+    }
+
+    struct LocalRing {
+        BinaryWriter* owner = nullptr;
+        std::shared_ptr<BinaryRing> ring;
+
+        ~LocalRing() {
+            if (ring != nullptr) {
+                ring->orphaned.store(true, std::memory_order_release);
+            }
+        }
+    };
+
+    BinaryRing& localRing() {
+        thread_local LocalRing local;
+        if (local.owner != this) {
+            if (local.ring != nullptr) {
+                local.ring->orphaned.store(true, std::memory_order_release);
+            }
+            local.ring = std::make_shared<BinaryRing>(config.bufferSize);
+            local.owner = this;
+            std::lock_guard l(ringsLock);
+            rings.push_back(local.ring);
+        }
+        return *local.ring;
+    }
+
+public:
+    BinaryWriter(const BinaryConfig& config)
+        : config(config),
+          colour(config.colour.value_or(
+              isFdTTY(config.fd) && stc::colour::getTerminalColourDepth() != stc::colour::ColourDepth::NONE
+          )) {
+        thread = std::thread(&BinaryWriter::run, this);
+    }
+
+    ~BinaryWriter() {
+        stop();
+    }
+
+    bool isColour() const {
+        return outputColour(colour);
+    }
+
+    /**
+     * Copies the arguments into the calling thread's ring.
+     */
+    template <Level level, class... Args>
+    void push(const std::format_string<Args...>& fmt, const Args&... args) {
+        auto view = fmt.get();
+        size_t size = sizeof(BinaryRecordHeader) + (size_t(0) + ... + binaryArgSize(args));
+        localRing().write(size, [&](char* out) {
+            BinaryRecordHeader header {
+                &decodeBinaryRecord<level, BinaryStored<Args>...>,
+                view.data(),
+                static_cast<uint32_t>(view.size()),
+                static_cast<uint32_t>(size),
+                std::chrono::system_clock::now().time_since_epoch().count(),
+            };
+            std::memcpy(out, &header, sizeof(header));
+            out += sizeof(header);
+            ((out = writeBinaryArg(out, args)), ...);
+        });
+    }
+
+    /**
+     * Copies an already formatted record into the calling thread's ring.
+     */
+    void pushText(std::string_view record) {
+        size_t size = sizeof(BinaryRecordHeader) + binaryArgSize(record);
+        localRing().write(size, [&](char* out) {
+            BinaryRecordHeader header {
+                &decodeTextRecord,
+                nullptr,
+                0,
+                static_cast<uint32_t>(size),
+                std::chrono::system_clock::now().time_since_epoch().count(),
+            };
+            std::memcpy(out, &header, sizeof(header));
+            writeBinaryArg(out + sizeof(header), record);
+        });
+    }
+
+    /**
+     * Blocks until everything logged before the call has been written.
+     */
+    void flush() {
+        // The pass that's running right now may have started before the call, so wait for the one after it, which is
+        // the first one guaranteed to see everything logged before the call
+        auto start = passes.load(std::memory_order_acquire);
+        auto current = start;
+        while (current < start + 2) {
+            {
+                std::lock_guard l(wakeLock);
+                wakeRequested = true;
+            }
+            wakeNotifier.notify_one();
+            passes.wait(current, std::memory_order_acquire);
+            current = passes.load(std::memory_order_acquire);
+        }
+    }
+
+    void stop() {
+        if (!thread.joinable()) {
+            return;
+        }
+        {
+            std::lock_guard l(wakeLock);
+            stopping = true;
+        }
+        wakeNotifier.notify_one();
+        thread.join();
+    }
+
+    size_t getDroppedCount() {
+        std::lock_guard l(ringsLock);
+        size_t drops = retiredDrops;
+        for (const auto& ring : rings) {
+            drops += ring->getDroppedCount();
+        }
+        return drops;
+    }
+};
+
+struct BinaryState {
+    std::atomic<BinaryWriter*> current = nullptr;
+
+    std::mutex lock;
+    std::vector<std::unique_ptr<BinaryWriter>> writers;
+};
+
+inline BinaryState binaryInstance;
+
+}
+
+/**
+ * Changes where records are written when not in async mode. The fd is not closed by minilog.
+ *
+ * \param fd        The file descriptor to write to.
+ * \param colour    Whether or not to colour the output. If std::nullopt, colour is used if the fd is a TTY, and the
+ *                  terminal supports colour.
+ */
+inline void setOutput(int fd, std::optional<bool> colour = std::nullopt) {
+    config().fd.store(fd, std::memory_order_relaxed);
+    config().colour.store(colour.has_value() ? int(*colour) : -1, std::memory_order_relaxed);
+}
+
+#ifndef _WIN32
+/**
+ * Starts writing records to a series of files instead of the output fd. This works with every mode; in sync mode, the
+ * logging thread appends the record itself, and in async and binary mode, the writer thread does.
+ *
+ * Each segment is preallocated to FileSinkConfig::segmentSize before it's used, so appending never has to grow the
+ * file. A background thread keeps the next segment opened and preallocated, which means rotating, whether it's by size
+ * or by time, only blocks logging threads for a pointer swap. When a segment is rotated out, the background thread
+ * trims off whatever wasn't used, and syncs and closes it. The current segment is synced every
+ * FileSinkConfig::fsyncInterval, rather than once per record.
+ *
+ * If a segment can't be opened when one is needed, records go to the output fd instead.
+ *
+ * Example use:
+ * ```cpp
+ * minilog::startFileSink({ .path = "/var/log/service/service.log", .rotateInterval = std::chrono::hours(24) });
+ * ```
+ *
+ * \throws std::runtime_error if a file sink is already running, or if the first segment can't be opened.
+ */
+inline void startFileSink(const FileSinkConfig& sinkConfig) {
+    auto& state = _detail::fileSinkInstance;
+    std::lock_guard l(state.lock);
+    if (state.current.load(std::memory_order_relaxed) != nullptr) {
+        throw std::runtime_error("minilog already has a file sink");
+    }
+    auto& sink = state.sinks.emplace_back(std::make_unique<_detail::FileSink>(sinkConfig));
+    state.current.store(sink.get(), std::memory_order_release);
+}
+
+/**
+ * Closes the current file sink, and goes back to writing to the output fd. If async or binary mode is running, call
+ * flush() first, or records that haven't been written yet end up on the fd.
+ */
+inline void stopFileSink() {
+    auto& state = _detail::fileSinkInstance;
+    std::lock_guard l(state.lock);
+    auto* sink = state.current.exchange(nullptr, std::memory_order_acq_rel);
+    if (sink != nullptr) {
+        sink->stop();
+    }
+}
+#endif
+
+/**
+ * Starts async mode. Until stopAsync() is called, log calls only format the record on the calling thread, and push it
+ * to a lock-free queue. A background thread writes everything in the queue to the fd with as few write() calls as
+ * possible. Records from a single thread are written in order, but records from different threads are only ordered
+ * by when they made it into the queue.
+ *
+ * Note that async mode writes directly to the fd, bypassing std::cout. Anything written to std::cout without going
+ * through minilog may be interleaved unpredictably with the log.
+ *
+ * \throws std::runtime_error if async mode is already running.
+ */
+inline void startAsync(const AsyncConfig& asyncConfig = {}) {
+    auto& state = _detail::asyncInstance;
+    std::lock_guard l(state.lock);
+    if (state.current.load(std::memory_order_relaxed) != nullptr) {
+        throw std::runtime_error("minilog is already running in async mode");
+    }
+    if (_detail::binaryInstance.current.load(std::memory_order_acquire) != nullptr) {
+        throw std::runtime_error("minilog is running in binary mode");
+    }
+    auto& writer = state.writers.emplace_back(std::make_unique<_detail::AsyncWriter>(asyncConfig));
+    state.current.store(writer.get(), std::memory_order_release);
+}
+
+/**
+ * Starts binary mode, which is meant for latency-critical threads where even formatting is too expensive. Until
+ * stopBinary() is called, log calls don't format anything; they copy a pointer identifying the callsite, a timestamp,
+ * and the raw arguments into a ring buffer owned by the calling thread. A consumer thread picks the records up,
+ * formats them, and writes them.
+ *
+ * Arguments are stored as raw bytes if they're isBinarySafe, and strings are copied. If any argument is neither, the
+ * record is formatted on the calling thread like in async mode, and stored as text, so nothing changes at the
+ * callsite either way.
+ *
+ * Logging threads never block in binary mode. If a thread's ring buffer is full, the record is dropped, and the
+ * consumer writes a line with the number of dropped records.
+ *
+ * Note that the records only make sense to the process that wrote them, as they contain pointers to its format strings
+ * and decoders. They can't be written to disk and decoded by another program.
+ *
+ * \throws std::runtime_error if binary or async mode is already running.
+ */
+inline void startBinary(const BinaryConfig& binaryConfig = {}) {
+    auto& state = _detail::binaryInstance;
+    std::lock_guard l(state.lock);
+    if (state.current.load(std::memory_order_relaxed) != nullptr) {
+        throw std::runtime_error("minilog is already running in binary mode");
+    }
+    if (_detail::asyncInstance.current.load(std::memory_order_acquire) != nullptr) {
+        throw std::runtime_error("minilog is running in async mode");
+    }
+    auto& writer = state.writers.emplace_back(std::make_unique<_detail::BinaryWriter>(binaryConfig));
+    state.current.store(writer.get(), std::memory_order_release);
+}
+
+/**
+ * Writes everything in the ring buffers, stops the consumer thread, and goes back to synchronous logging. Like
+ * stopAsync(), records logged by other threads while this is running may be lost.
+ */
+inline void stopBinary() {
+    auto& state = _detail::binaryInstance;
+    std::lock_guard l(state.lock);
+    auto* writer = state.current.exchange(nullptr, std::memory_order_acq_rel);
+    if (writer != nullptr) {
+        writer->stop();
+    }
+}
+
+/**
+ * Blocks until every record logged before the call has been written. Does nothing if neither async nor binary mode is
+ * running.
+ */
+inline void flush() {
+    if (auto* writer = _detail::asyncInstance.current.load(std::memory_order_acquire); writer != nullptr) {
+        writer->flush();
+    }
+    if (auto* writer = _detail::binaryInstance.current.load(std::memory_order_acquire); writer != nullptr) {
+        writer->flush();
+    }
+}
+
+/**
+ * Writes all queued records, stops the writer thread, and goes back to synchronous logging. Records logged by other
+ * threads while this is running may be lost, so stop logging from other threads first.
+ */
+inline void stopAsync() {
+    auto& state = _detail::asyncInstance;
+    std::lock_guard l(state.lock);
+    auto* writer = state.current.exchange(nullptr, std::memory_order_acq_rel);
+    if (writer != nullptr) {
+        writer->stop();
+    }
+}
+
+/**
+ * \returns the number of records dropped by the current async or binary writer because its queue was full, or 0 if
+ *          neither mode is running.
+ */
+inline size_t getDroppedCount() {
+    if (auto* writer = _detail::asyncInstance.current.load(std::memory_order_acquire); writer != nullptr) {
+        return writer->getDroppedCount();
+    }
+    if (auto* writer = _detail::binaryInstance.current.load(std::memory_order_acquire); writer != nullptr) {
+        return writer->getDroppedCount();
+    }
+    return 0;
+}
+
+namespace _detail {
+
+/**
+ * \returns the time used for rate limits. A coarse clock is used where there is one, as it's several times cheaper
+ *          to read, and a few milliseconds of jitter don't matter for rate limits.
+ */
+inline std::chrono::nanoseconds rateLimitNow() {
+#ifdef CLOCK_MONOTONIC_COARSE
+    timespec now;
+    clock_gettime(CLOCK_MONOTONIC_COARSE, &now);
+    return std::chrono::seconds(now.tv_sec) + std::chrono::nanoseconds(now.tv_nsec);
+#else
+    return std::chrono::steady_clock::now().time_since_epoch();
+#endif
+}
+
+}
+
+/**
+ * Rate limit for a single callsite, for records that can end up in a hot loop, like errors from a dependency that's
+ * down. Allows up to `burst` records per `interval`, and counts the rest as suppressed. The first record let through
+ * in a new interval carries the number of records suppressed in the previous one, so it can be reported.
+ *
+ * Like the kernel's printk_ratelimit, the bucket is refilled all at once at the start of each interval, rather than
+ * continuously. This means the interval and the count fit in a single atomic, and checking it is one relaxed
+ * fetch_add, whether the record is let through or not. Only the first check in a new interval does a CAS.
+ *
+ * Usually, you want MINILOG_LOG_LIMITED, which gives each callsite its own RateLimit, and skips evaluating the
+ * arguments of suppressed records. To share a limit between several callsites, create a RateLimit and use logLimited.
+ */
+class RateLimit {
+public:
+    struct Result {
+        bool allowed;
+        /**
+         * The number of records suppressed in the previous interval. Only non-zero for the first record let through in
+         * an interval. Saturates a little below 2^32.
+         */
+        uint32_t suppressed;
+    };
+
+private:
+    /**
+     * Set once the limit has been used. Interval numbers can't double as this, as any of them can show up in practice.
+     */
+    static constexpr uint64_t usedBit = uint64_t(1) << 63;
+    /**
+     * Interval numbers are truncated to 31 bits, to make room for usedBit.
+     */
+    static constexpr uint32_t windowMask = 0x7FFF'FFFF;
+    /**
+     * Counts stop going up at this point, so they never carry into the interval number. It's checked before adding, so
+     * the headroom above it covers threads that check at the same time.
+     */
+    static constexpr uint32_t saturated = 0xFFFF'0000;
+
+    uint32_t burst;
+    int64_t interval;
+    /**
+     * usedBit, the truncated interval number in the remaining upper 31 bits, and the number of checks in that interval
+     * in the lower 32 bits.
+     */
+    std::atomic<uint64_t> state = 0;
+
+    /**
+     * \returns whether a check in `window` starts a new window, given the state from before the check.
+     */
+    static bool startsWindow(uint64_t old, uint32_t window) {
+        // Compared as a sign-extended 31-bit difference, so it survives the window number wrapping around. Threads
+        // that read the clock just before another thread started a new window count towards the new window. An unused
+        // limit always starts a window, as the first window can be arbitrarily far from whatever is stored.
+        auto oldWindow = static_cast<uint32_t>(old >> 32) & windowMask;
+        auto diff = static_cast<int32_t>((window - oldWindow) << 1) >> 1;
+        return (old & usedBit) == 0 || diff > 0;
+    }
+
+public:
+    /**
+     * \throws std::runtime_error if the interval isn't positive.
+     */
+    constexpr RateLimit(uint32_t burst, std::chrono::nanoseconds interval) : burst(burst), interval(interval.count()) {
+        if (interval.count() <= 0) {
+            throw std::runtime_error("The rate limit interval must be positive");
+        }
+    }
+
+    Result check() {
+        return check(_detail::rateLimitNow());
+    }
+
+    /**
+     * Checks whether a record at the given time is allowed. The time must come from a monotonic clock, and be
+     * consistent between calls; this overload mainly exists for testing.
+     */
+    Result check(std::chrono::nanoseconds now) {
+        auto window = static_cast<uint32_t>(now.count() / interval) & windowMask;
+        uint64_t old = state.load(std::memory_order_relaxed);
+        if (static_cast<uint32_t>(old) >= saturated && !startsWindow(old, window)) {
+            return { static_cast<uint32_t>(old) < burst, 0 };
+        }
+        old = state.fetch_add(1, std::memory_order_relaxed);
+        auto count = static_cast<uint32_t>(old);
+
+        if (startsWindow(old, window)) {
+            uint64_t expected = old + 1;
+            uint64_t started = usedBit | (uint64_t(window) << 32) | 1;
+            while ((expected >> 32) == (old >> 32)) {
+                if (state.compare_exchange_weak(expected, started, std::memory_order_relaxed)) {
+                    // Not counting this check, which belongs to the new window
+                    auto total = static_cast<uint32_t>(expected) - 1;
+                    return { burst > 0, total > burst ? total - burst : 0 };
+                }
+            }
+            // Someone else started the window. This check still went to the old one, as the other thread's CAS saw it
+        }
+        return { count < burst, 0 };
+    }
+};
+
 template <Level level, class... Args>
 inline constexpr void log(const std::format_string<Args...>& fmt, Args&&... args) {
-    if (config().level > level) {
+    if constexpr (static_cast<int>(level) < minLevel) {
+        return;
+    }
+    if (!isEnabled<level>()) {
+        return;
+    }
+
+    if (auto* writer = _detail::binaryInstance.current.load(std::memory_order_acquire); writer != nullptr) {
+        if constexpr ((_detail::BinaryEncodable<Args> && ...)) {
+            writer->push<level, Args...>(fmt, args...);
+        } else {
+            writer->pushText(
+                _detail::formatRecord<level, Args...>(writer->isColour(), fmt, std::forward<Args>(args)...)
+            );
+        }
+        return;
+    }
+    if (auto* writer = _detail::asyncInstance.current.load(std::memory_order_acquire); writer != nullptr) {
+        writer->push(_detail::formatRecord<level, Args...>(writer->isColour(), fmt, std::forward<Args>(args)...));
         return;
     }
 
-    // This is good enough:
-    // https://stackoverflow.com/a/26909227
-    //
-    // This isn't going to win any performance awards by any metric, but it's good enough for now. 
-    // Not sure if I'll ever revisit performance.
-    std::cout 
-        << level
-        << std::format(
-            "{:%T} | {:<8} | {}\n",
-            std::chrono::floor<std::chrono::milliseconds>(
-                std::chrono::system_clock::now()
-            ),
-            levelToString<level>(),
-            std::format<Args...>(fmt, std::forward<Args>(args)...)
-        )
-        << stc::colour::reset
-        << std::flush;
+    // Writing straight to the fd means the record is never split up, even if several threads log at once (as long as
+    // it fits in a single write, which is up to the OS), and there's no stream state or locale to go through
+    auto& buffer = _detail::recordBuffer();
+    _detail::formatRecordTo<level, Args...>(
+        buffer,
+        _detail::outputColour(_detail::useColour()),
+        fmt,
+        std::forward<Args>(args)...
+    );
+    _detail::writeOutput(config().fd.load(std::memory_order_relaxed), buffer);
 }
 
+/**
+ * Logs a structured record: a fixed message, and a set of key-value pairs created with kv().
+ * ```cpp
+ * minilog::logKV<minilog::Level::Info>("request done", minilog::kv("ms", 12), minilog::kv("path", path));
+ * ```
+ * The record is encoded according to config().format, straight into the record buffer; there's no intermediate
+ * std::format call for the message, and nothing is allocated once the buffer has grown to fit. Numbers, bools, and
+ * strings are written directly, and other values go through their std::formatter.
+ *
+ * In binary mode, structured records are encoded on the calling thread, like records with arguments that aren't
+ * binary-safe.
+ */
+template <Level level, typename... Ts>
+inline void logKV(std::string_view message, const KV<Ts>&... fields) {
+    if constexpr (static_cast<int>(level) < minLevel) {
+        return;
+    }
+    if (!isEnabled<level>()) {
+        return;
+    }
+
+    auto& buffer = _detail::recordBuffer();
+    if (auto* writer = _detail::binaryInstance.current.load(std::memory_order_acquire); writer != nullptr) {
+        _detail::formatKVRecordTo<level>(buffer, writer->isColour(), message, fields...);
+        writer->pushText(buffer);
+        return;
+    }
+    if (auto* writer = _detail::asyncInstance.current.load(std::memory_order_acquire); writer != nullptr) {
+        _detail::formatKVRecordTo<level>(buffer, writer->isColour(), message, fields...);
+        writer->push(std::string(buffer));
+        return;
+    }
+    _detail::formatKVRecordTo<level>(buffer, _detail::outputColour(_detail::useColour()), message, fields...);
+    _detail::writeOutput(config().fd.load(std::memory_order_relaxed), buffer);
+}
+
+namespace _detail {
+
+template <Level level>
+inline void logSuppressed(uint32_t suppressed) {
+    if (suppressed != 0) {
+        log<level>("suppressed {} similar messages", suppressed);
+    }
+}
+
+}
+
+/**
+ * Same as minilog::log, but only if the rate limit allows it. If records were suppressed in the previous interval, a
+ * line with the number of suppressed records is logged first.
+ */
+template <Level level, class... Args>
+inline void logLimited(RateLimit& limit, const std::format_string<Args...>& fmt, Args&&... args) {
+    if constexpr (static_cast<int>(level) < minLevel) {
+        return;
+    }
+    // Checked first, so records below the level don't use up the limit
+    if (!isEnabled<level>()) {
+        return;
+    }
+    if (auto result = limit.check(); result.allowed) {
+        _detail::logSuppressed<level>(result.suppressed);
+        log<level, Args...>(fmt, std::forward<Args>(args)...);
+    }
+}
 
 template <class... Args>
 [[deprecated("Minilog has been separated into a bigger project: https://codeberg.org/LunarWatcher/minilog")]]
@@ -125,3 +2340,39 @@ inline constexpr void critical(const std::format_string<Args...>& format, Args&&
 }
 
 }
+
+/**
+ * Same as minilog::log, but the arguments are only evaluated if the level is enabled. Useful when the arguments are
+ * expensive to compute:
+ * ```cpp
+ * MINILOG_LOG(minilog::Level::Debug, "State: {}", dumpState());
+ * ```
+ */
+#define MINILOG_LOG(level, ...) \
+    do { \
+        if (::minilog::isEnabled<level>()) { \
+            ::minilog::log<level>(__VA_ARGS__); \
+        } \
+    } while (false)
+
+/**
+ * Same as MINILOG_LOG, but rate limited per callsite: at most `burst` records are logged per `interval`, and the
+ * arguments are only evaluated for records that are let through. See minilog::RateLimit.
+ * ```cpp
+ * while (true) {
+ *     if (auto err = poll(); err) {
+ *         MINILOG_LOG_LIMITED(minilog::Level::Error, 10, std::chrono::seconds(1), "Poll failed: {}", describe(err));
+ *     }
+ * }
+ * ```
+ */
+#define MINILOG_LOG_LIMITED(level, burst, interval, ...) \
+    do { \
+        if (::minilog::isEnabled<level>()) { \
+            static ::minilog::RateLimit minilogRateLimit(burst, interval); \
+            if (auto minilogResult = minilogRateLimit.check(); minilogResult.allowed) { \
+                ::minilog::_detail::logSuppressed<level>(minilogResult.suppressed); \
+                ::minilog::log<level>(__VA_ARGS__); \
+            } \
+        } \
+    } while (false)
@@ -14,8 +14,10 @@
  * Note that the API used here is not finalised, and is subject to change, including total breakage.
  */
 
+#include <algorithm>
 #include <array>
 #include <atomic>
+#include <chrono>
 #include <cstdlib>
 #include <cstring>
 #include <fcntl.h>
@@ -23,21 +25,38 @@
 #include <format>
 #include <functional>
 #include <iostream>
+#include <iterator>
 #include <map>
 #include <memory>
 #include <mutex>
 #include <optional>
 #include <pty.h>
+#include <sched.h>
 #include <sstream>
 #include <string>
 #include <string_view>
 #include <sys/poll.h>
+#include <sys/ioctl.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
 #include <sys/wait.h>
+#include <termios.h>
 #include <thread>
 #include <unistd.h>
+#include <unordered_map>
 #include <variant>
 #include <vector>
 
+#include "../AnsiParser.hpp"
+#include "../Environment.hpp"
+#include "../FileUtil.hpp"
+#include "../StringUtil.hpp"
+
+#ifdef __linux__
+#include "SharedRingBuffer.hpp"
+#include <sys/syscall.h>
+#endif
+
 // TODO: this cannot be "unix", or the build inexplicably dies ("unexpected { before numeric constant")
 // It's probably a macro
 namespace stc::Unix {
@@ -107,6 +126,38 @@ struct LowLevelWrapper {
         return sum;
     }
 
+    /**
+     * Reads everything currently available from the fd, and passes it on to the consumer one chunk at a time. Unlike
+     * readFromFd(std::array<char, 4096>&, int), this keeps reading until there's no more data, so it doesn't leave
+     * anything behind in the final read after the process has exited.
+     */
+    ssize_t readFromFd(const std::function<void(std::string_view)>& consumer, int fd) {
+        thread_local std::array<char, 4096> buff;
+        ssize_t sum = 0;
+
+        nfds_t nfds = 1;
+        pollfd pdfs = {
+            .fd = fd,
+            .events = POLLIN,
+            .revents = 0
+        };
+
+        // we need a small timeout here to prevent race conditions
+        while (poll(&pdfs, nfds, 10) > 0) {
+            ssize_t bytes = read(
+                fd,
+                buff.data(),
+                buff.size()
+            );
+            if (bytes <= 0) {
+                break;
+            }
+            consumer(std::string_view(buff.data(), static_cast<size_t>(bytes)));
+            sum += bytes;
+        }
+        return sum;
+    }
+
     virtual int readFd() = 0;
 };
 
@@ -152,16 +203,57 @@ struct Pipe : public LowLevelWrapper {
     }
 };
 
+struct PTYConfig {
+    /**
+     * Whether or not to put the PTY in raw mode (see cfmakeraw). In raw mode, the line discipline does no processing
+     * at all, so output is passed through byte for byte (no `\n` -> `\r\n` conversion), input is not echoed, and input
+     * is not line buffered. This is what you want if you're capturing binary output or the output of TUI programs at
+     * high rates, as it skips the per-byte processing in the kernel, and avoids extra bytes in the output.
+     */
+    bool raw = false;
+
+    /**
+     * Whether or not input written to the PTY is echoed back into the output. Ignored if raw == true, as raw mode
+     * always disables echo.
+     */
+    bool echo = true;
+
+    /**
+     * The initial window size. If not set, the kernel default (0x0) is used, which some programs treat as "not a
+     * terminal".
+     */
+    std::optional<winsize> windowSize = std::nullopt;
+};
+
 struct PTY : public LowLevelWrapper {
     int master, slave;
 
-    PTY() {
-        // TODO: figure out if it makes sense to:
-        // 1. store the name
-        // 2. Allow customising whatever the last two parameters are
-        if (openpty(&master, &slave, nullptr, nullptr, nullptr) == -1) {
+    PTY(const PTYConfig& config = {}) {
+        // TODO: figure out if it makes sense to store the name
+        if (openpty(
+            &master, &slave,
+            nullptr, nullptr,
+            config.windowSize.has_value() ? &*config.windowSize : nullptr
+        ) == -1) {
             throw std::runtime_error("Failed to open PTY");
         }
+
+        if (config.raw || !config.echo) {
+            termios attrs;
+            if (tcgetattr(slave, &attrs) != 0) {
+                die();
+                throw std::runtime_error("Failed to get PTY attributes");
+            }
+            if (config.raw) {
+                cfmakeraw(&attrs);
+            } else {
+                attrs.c_lflag &= ~(ECHO | ECHOE | ECHOK | ECHONL);
+            }
+            if (tcsetattr(slave, TCSANOW, &attrs) != 0) {
+                die();
+                throw std::runtime_error("Failed to set PTY attributes");
+            }
+        }
     }
     ~PTY() {
         die();
@@ -203,6 +295,27 @@ struct PTY : public LowLevelWrapper {
     ssize_t readData(std::stringstream& out) {
         return readFromFd(out, master);
     }
+
+    /**
+     * Changes the window size of the PTY.
+     *
+     * Note that this only sends SIGWINCH on its own if the PTY is the controlling terminal of the process reading from
+     * it, which is not the case for processes started with stc::Unix::Process. Use Process::resize() instead, which
+     * also notifies the child.
+     *
+     * \throws std::runtime_error if the size can't be changed
+     */
+    void resize(unsigned short rows, unsigned short cols) {
+        winsize size {
+            .ws_row = rows,
+            .ws_col = cols,
+            .ws_xpixel = 0,
+            .ws_ypixel = 0,
+        };
+        if (ioctl(master, TIOCSWINSZ, &size) != 0) {
+            throw std::runtime_error("Failed to resize PTY");
+        }
+    }
 };
 
 /**
@@ -260,10 +373,58 @@ struct Pipes {
 /**
  * Shorthand for creating a new PTY. Saves a few characters, does nothing special aside calling std::make_shared
  */
-inline std::shared_ptr<PTY> createPTY() {
-    return std::make_shared<PTY>();
+inline std::shared_ptr<PTY> createPTY(const PTYConfig& config = {}) {
+    return std::make_shared<PTY>(config);
 }
 
+/**
+ * I/O scheduling classes, as used by ioprio_set. Linux only.
+ *
+ * \see https://man7.org/linux/man-pages/man2/ioprio_set.2.html
+ */
+enum class IOPriorityClass {
+    NONE = 0,
+    /**
+     * Requires CAP_SYS_ADMIN
+     */
+    REALTIME = 1,
+    BEST_EFFORT = 2,
+    /**
+     * Only gets disk time when no other process has asked for it for a while. Does not take a level.
+     */
+    IDLE = 3,
+};
+
+struct IOPriority {
+    IOPriorityClass ioClass = IOPriorityClass::BEST_EFFORT;
+    /**
+     * The priority within the class, from 0 (highest) to 7 (lowest). Ignored for IOPriorityClass::IDLE and
+     * IOPriorityClass::NONE.
+     */
+    int level = 4;
+};
+
+/**
+ * Non-realtime scheduling policies. Realtime policies are intentionally not supported, as they require privileges and
+ * a priority, and are a great way to lock up a system if the child misbehaves.
+ *
+ * \see https://man7.org/linux/man-pages/man7/sched.7.html
+ */
+enum class SchedulingPolicy {
+    /**
+     * SCHED_OTHER, the default policy.
+     */
+    OTHER,
+    /**
+     * SCHED_BATCH. Linux only. For CPU-bound, non-interactive processes.
+     */
+    BATCH,
+    /**
+     * SCHED_IDLE. Linux only. For very low priority background jobs; lower priority than nice 19.
+     */
+    IDLE,
+};
+
 struct Environment {
     std::map<std::string, std::string> env = {};
     /**
@@ -277,12 +438,55 @@ struct Environment {
      */
     std::optional<std::string> workingDirectory = std::nullopt;
 
+    /**
+     * If defined, the CPUs the spawned process is allowed to run on, identified by their CPU number. Equivalent to
+     * `taskset --cpu-list`, but without the extra exec. Linux only.
+     */
+    std::optional<std::vector<int>> cpuAffinity = std::nullopt;
+
+    /**
+     * If defined, the nice value of the spawned process, from -20 (highest priority) to 19 (lowest priority). Note
+     * that lowering the nice value below the parent's generally requires privileges.
+     */
+    std::optional<int> niceness = std::nullopt;
+
+    /**
+     * If defined, the I/O priority of the spawned process. Equivalent to `ionice`. Linux only.
+     */
+    std::optional<IOPriority> ioPriority = std::nullopt;
+
+    /**
+     * If defined, the scheduling policy of the spawned process.
+     */
+    std::optional<SchedulingPolicy> schedulingPolicy = std::nullopt;
+
+#ifdef __linux__
+    /**
+     * Shared memory buffers to hand to the spawned process. The key is the name of an environment variable, which is
+     * set to the fd number of the buffer in the child. The child can then attach to it with
+     * SharedRingBuffer::fromEnv(key).
+     *
+     * The buffers are exported even if extendEnviron is false.
+     */
+    std::map<std::string, std::shared_ptr<SharedRingBuffer>> sharedBuffers = {};
+#endif
+
     void validate() const {
         for (auto& [k, v] : env) {
             if (k.find('=') != std::string::npos) {
                 throw std::runtime_error("Illegal key: " + k);
             }
         }
+#ifdef __linux__
+        for (auto& [k, v] : sharedBuffers) {
+            if (k.find('=') != std::string::npos) {
+                throw std::runtime_error("Illegal key: " + k);
+            }
+            if (v == nullptr) {
+                throw std::runtime_error("Shared buffer " + k + " is null");
+            }
+        }
+#endif
 
         if (workingDirectory.has_value() && !std::filesystem::is_directory(*workingDirectory)) {
             throw std::runtime_error(
@@ -292,11 +496,196 @@ struct Environment {
                 )
             );
         }
+
+        if (niceness.has_value() && (*niceness < -20 || *niceness > 19)) {
+            throw std::runtime_error(
+                std::format("Niceness must be between -20 and 19, not {}", *niceness)
+            );
+        }
+
+#ifdef __linux__
+        if (cpuAffinity.has_value()) {
+            if (cpuAffinity->empty()) {
+                throw std::runtime_error("cpuAffinity cannot be empty");
+            }
+            for (auto cpu : *cpuAffinity) {
+                if (cpu < 0 || cpu >= CPU_SETSIZE) {
+                    throw std::runtime_error(std::format("Invalid CPU in cpuAffinity: {}", cpu));
+                }
+            }
+        }
+        if (ioPriority.has_value() && (ioPriority->level < 0 || ioPriority->level > 7)) {
+            throw std::runtime_error(
+                std::format("I/O priority level must be between 0 and 7, not {}", ioPriority->level)
+            );
+        }
+#else
+        if (cpuAffinity.has_value() || ioPriority.has_value()
+            || (schedulingPolicy.has_value() && schedulingPolicy != SchedulingPolicy::OTHER)) {
+            throw std::runtime_error("cpuAffinity, ioPriority, and non-default scheduling policies are Linux only");
+        }
+#endif
+    }
+
+    /**
+     * \returns whether or not any of the scheduling-related options are set.
+     */
+    bool hasSchedulingOptions() const {
+        return cpuAffinity.has_value()
+            || niceness.has_value()
+            || ioPriority.has_value()
+            || schedulingPolicy.has_value();
     }
 };
 
 struct Config {
     bool verboseUserOutput = false;
+
+    /**
+     * Whether or not to look up `command[0]` in PATH if it's a bare command name, i.e. a name without any `/`. This
+     * mirrors what execvp and shells do, and removes the need for going through `/usr/bin/env` just to find a command,
+     * which saves an entire exec per spawn.
+     *
+     * Commands containing a `/` are always passed as-is, so absolute and relative paths (`./some-binary`) are
+     * unaffected.
+     *
+     * \see PathCache
+     */
+    bool searchPath = true;
+};
+
+/**
+ * Cache for resolving bare command names against a PATH-style search path.
+ *
+ * Resolved names (including failed lookups) are cached per PATH value. A cached entry is thrown out if the PATH value
+ * changes, or if the modification time of any of the directories in the PATH changes, which happens when files are
+ * added, removed, or renamed in the directory. The mtimes are checked on each lookup, which is one stat per directory
+ * in PATH; that's still significantly cheaper than a PATH traversal, and a lot cheaper than an extra exec.
+ *
+ * Relative directories in PATH (including empty entries, which mean the current working directory) are resolved
+ * relative to the working directory at the time the PATH value was first seen.
+ *
+ * The cache is thread-safe.
+ */
+class PathCache {
+private:
+    struct SearchDirectory {
+        std::filesystem::path path;
+        std::optional<std::filesystem::file_time_type> mtime;
+    };
+
+    struct SearchPath {
+        std::vector<SearchDirectory> directories;
+        std::unordered_map<std::string, std::optional<std::filesystem::path>> resolved;
+    };
+
+    std::mutex lock;
+    std::unordered_map<std::string, SearchPath> searchPaths;
+
+    static std::optional<std::filesystem::file_time_type> getMtime(const std::filesystem::path& path) {
+        std::error_code ec;
+        auto mtime = std::filesystem::last_write_time(path, ec);
+        if (ec) {
+            return std::nullopt;
+        }
+        return mtime;
+    }
+
+    static SearchPath parseSearchPath(const std::string& path) {
+        SearchPath out;
+        size_t start = 0;
+        while (true) {
+            auto end = path.find(':', start);
+            std::string dir = path.substr(
+                start,
+                end == std::string::npos ? std::string::npos : end - start
+            );
+            std::error_code ec;
+            auto absolute = std::filesystem::absolute(dir.empty() ? "." : dir, ec);
+            if (!ec) {
+                out.directories.push_back({
+                    absolute,
+                    getMtime(absolute)
+                });
+            }
+
+            if (end == std::string::npos) {
+                break;
+            }
+            start = end + 1;
+        }
+        return out;
+    }
+
+public:
+    /**
+     * Looks up a command name in the provided search path.
+     *
+     * \param name   The bare command name to look up. Must not contain a `/`.
+     * \param path   A colon-separated list of directories, in the same format as the PATH environment variable.
+     * \returns      The absolute path to the first executable file called `name` in `path`, or std::nullopt if no
+     *               such file exists.
+     */
+    std::optional<std::filesystem::path> resolve(const std::string& name, const std::string& path) {
+        std::lock_guard g(lock);
+        auto it = searchPaths.find(path);
+        if (it == searchPaths.end()) {
+            it = searchPaths.emplace(path, parseSearchPath(path)).first;
+        } else {
+            for (auto& dir : it->second.directories) {
+                auto mtime = getMtime(dir.path);
+                if (mtime != dir.mtime) {
+                    dir.mtime = mtime;
+                    it->second.resolved.clear();
+                }
+            }
+        }
+
+        auto& searchPath = it->second;
+        if (auto cached = searchPath.resolved.find(name); cached != searchPath.resolved.end()) {
+            return cached->second;
+        }
+
+        std::vector<std::filesystem::path> directories;
+        directories.reserve(searchPath.directories.size());
+        for (auto& dir : searchPath.directories) {
+            directories.push_back(dir.path);
+        }
+
+        auto result = stc::FileUtil::findFile(
+            directories,
+            name,
+            [](const std::filesystem::path& candidate) {
+                return access(candidate.c_str(), X_OK) == 0;
+            }
+        );
+        searchPath.resolved[name] = result;
+        return result;
+    }
+
+    /**
+     * Drops all cached entries.
+     */
+    void invalidate() {
+        std::lock_guard g(lock);
+        searchPaths.clear();
+    }
+
+    /**
+     * \returns the PATH of the current process, or the same default execvp uses if PATH is undefined.
+     */
+    static std::string getProcessPath() {
+        const char* path = std::getenv("PATH");
+        if (path == nullptr) {
+            return "/bin:/usr/bin";
+        }
+        return path;
+    }
+
+    static PathCache& getInstance() {
+        static PathCache instance;
+        return instance;
+    }
 };
 
 struct ReadHandler {
@@ -304,6 +693,18 @@ struct ReadHandler {
         LowLevelWrapper* primitive
     ) = 0;
     virtual void flush() {}
+
+    /**
+     * Receives data that has already been read from the fd by something else. This is used by TeeReadHandler to hand
+     * the same chunk to several handlers. The data is only valid for the duration of the call.
+     *
+     * Implementing this is optional, but handlers that don't can't be used with TeeReadHandler.
+     *
+     * \throws std::runtime_error if not supported by the handler
+     */
+    virtual void consume(std::string_view) {
+        throw std::runtime_error("This ReadHandler does not support consuming pre-read data");
+    }
 };
 
 struct InMemoryReadHandler : public ReadHandler {
@@ -317,6 +718,10 @@ struct InMemoryReadHandler : public ReadHandler {
         );
     }
 
+    virtual void consume(std::string_view data) override {
+        ss.write(data.data(), static_cast<std::streamsize>(data.size()));
+    }
+
     std::string getStream(bool reset = false) {
         std::string d = ss.str();
 
@@ -339,19 +744,21 @@ struct FdRedirectInputHandler : public ReadHandler {
     virtual void read(
         LowLevelWrapper* primitive
     ) override {
-        thread_local std::array<char, 4096> buff;
-        ssize_t bytes = primitive->readFromFd(
-            buff,
+        primitive->readFromFd(
+            [this](std::string_view data) { consume(data); },
             primitive->readFd()
         );
+    }
 
-        if (bytes > 0) {
-            auto written = write(fd, buff.data(), bytes);
+    virtual void consume(std::string_view data) override {
+        while (!data.empty()) {
+            auto written = write(fd, data.data(), data.size());
 
             if (written <= 0) {
                 std::cerr << "Writing failed: " << strerror(errno) << std::endl;
                 throw std::runtime_error("Failed to write to output buffer");
             }
+            data.remove_prefix(static_cast<size_t>(written));
         }
     }
 
@@ -360,6 +767,496 @@ struct FdRedirectInputHandler : public ReadHandler {
     }
 };
 
+/**
+ * ReadHandler that calls a callback for each line of output. The callback gets the line without the trailing `\n`.
+ *
+ * A trailing line without a `\n` is held back until more output arrives, or until flush() is called.
+ */
+struct LineCallbackReadHandler : public ReadHandler {
+    std::function<void(std::string_view)> callback;
+    std::string pending;
+
+    LineCallbackReadHandler(const std::function<void(std::string_view)>& callback) : callback(callback) {}
+
+    virtual void read(
+        LowLevelWrapper* primitive
+    ) override {
+        primitive->readFromFd(
+            [this](std::string_view data) { consume(data); },
+            primitive->readFd()
+        );
+    }
+
+    virtual void consume(std::string_view data) override {
+        size_t end;
+        while ((end = data.find('\n')) != std::string_view::npos) {
+            if (pending.empty()) {
+                // Fast path: the whole line is in this chunk, so it can be passed on without copying
+                callback(data.substr(0, end));
+            } else {
+                pending.append(data.substr(0, end));
+                callback(pending);
+                pending.clear();
+            }
+            data.remove_prefix(end + 1);
+        }
+        pending.append(data);
+    }
+
+    void flush() override {
+        if (!pending.empty()) {
+            callback(pending);
+            pending.clear();
+        }
+    }
+};
+
+/**
+ * ReadHandler that reads each chunk once, and passes it on to several other handlers. This is useful if, for example,
+ * output needs to be both captured in memory and streamed to a file. The downstream handlers must implement
+ * ReadHandler::consume().
+ *
+ * When reading from a pipe, FdRedirectInputHandlers whose fd is a regular file, a pipe, or a socket are fed with
+ * tee(2) and splice(2) instead, so the data moves between the fds without being copied through userspace. If all the
+ * downstream handlers are of this type, the data is never copied into userspace at all.
+ */
+struct TeeReadHandler : public ReadHandler {
+    std::vector<std::shared_ptr<ReadHandler>> handlers;
+
+    TeeReadHandler(const std::vector<std::shared_ptr<ReadHandler>>& handlers) : handlers(handlers) {
+        for (auto& handler : handlers) {
+            if (handler == nullptr) {
+                throw std::runtime_error("TeeReadHandler cannot take null handlers");
+            }
+            if (auto fdHandler = std::dynamic_pointer_cast<FdRedirectInputHandler>(handler);
+                fdHandler != nullptr && canSplice(fdHandler->fd)) {
+                spliceTargets.push_back(fdHandler->fd);
+            } else {
+                copyTargets.push_back(handler.get());
+            }
+        }
+    }
+
+    virtual void read(
+        LowLevelWrapper* primitive
+    ) override {
+#ifdef __linux__
+        if (!spliceTargets.empty() && dynamic_cast<Pipe*>(primitive) != nullptr) {
+            while (readSplice(primitive->readFd())) {}
+            return;
+        }
+#endif
+        primitive->readFromFd(
+            [this](std::string_view data) {
+                for (auto& handler : handlers) {
+                    handler->consume(data);
+                }
+            },
+            primitive->readFd()
+        );
+    }
+
+    void flush() override {
+        for (auto& handler : handlers) {
+            handler->flush();
+        }
+    }
+
+private:
+    std::vector<int> spliceTargets;
+    std::vector<ReadHandler*> copyTargets;
+    std::unique_ptr<Pipe> scratch;
+
+    static bool canSplice(int fd) {
+#ifdef __linux__
+        struct stat st;
+        if (fstat(fd, &st) != 0) {
+            return false;
+        }
+        // Notably excludes TTYs, which don't support splice
+        return S_ISREG(st.st_mode) || S_ISFIFO(st.st_mode) || S_ISSOCK(st.st_mode);
+#else
+        return false;
+#endif
+    }
+
+#ifdef __linux__
+    /**
+     * Moves exactly `size` bytes from `from` to `to` with splice(2), falling back to read and write if the fds turn out
+     * not to support it.
+     */
+    static void spliceAll(int from, int to, size_t size) {
+        while (size > 0) {
+            auto moved = splice(from, nullptr, to, nullptr, size, SPLICE_F_MOVE);
+            if (moved > 0) {
+                size -= static_cast<size_t>(moved);
+                continue;
+            }
+            if (moved < 0 && errno == EINTR) {
+                continue;
+            }
+            std::array<char, 4096> buff;
+            auto bytes = ::read(from, buff.data(), std::min(size, buff.size()));
+            if (bytes <= 0) {
+                throw std::runtime_error("Failed to move data between fds");
+            }
+            // Written directly rather than through FdRedirectInputHandler, as its destructor fsyncs the fd
+            std::string_view data(buff.data(), static_cast<size_t>(bytes));
+            while (!data.empty()) {
+                auto written = ::write(to, data.data(), data.size());
+                if (written < 0 && errno == EINTR) {
+                    continue;
+                }
+                if (written <= 0) {
+                    throw std::runtime_error("Failed to move data between fds");
+                }
+                data.remove_prefix(static_cast<size_t>(written));
+            }
+            size -= static_cast<size_t>(bytes);
+        }
+    }
+
+    /**
+     * Processes one round of data with tee and splice.
+     *
+     * \returns whether or not any data was processed
+     */
+    bool readSplice(int fd) {
+        pollfd pfd = {
+            .fd = fd,
+            .events = POLLIN,
+            .revents = 0
+        };
+        // Same timeout as LowLevelWrapper::readFromFd, for the same reason
+        if (poll(&pfd, 1, 10) <= 0 || (pfd.revents & POLLIN) == 0) {
+            return false;
+        }
+        int available = 0;
+        if (ioctl(fd, FIONREAD, &available) != 0 || available <= 0) {
+            return false;
+        }
+        // Capped to the default pipe capacity, so it's guaranteed to fit in the scratch pipe
+        size_t bytes = std::min(static_cast<size_t>(available), static_cast<size_t>(1 << 16));
+
+        // If nothing needs the data in userspace, the last target can take it straight from the source, which also
+        // consumes it. Every other target gets a tee()d copy via the scratch pipe, as tee() doesn't consume anything.
+        bool lastFromSource = copyTargets.empty();
+        size_t teeTargets = lastFromSource ? spliceTargets.size() - 1 : spliceTargets.size();
+        if (teeTargets > 0 && scratch == nullptr) {
+            scratch = std::make_unique<Pipe>();
+        }
+        for (size_t i = 0; i < teeTargets; ++i) {
+            auto copied = tee(fd, scratch->writeFd(), bytes, 0);
+            if (copied <= 0 || (i != 0 && static_cast<size_t>(copied) != bytes)) {
+                throw std::runtime_error("Failed to tee data");
+            }
+            // tee() always starts from the front of the pipe, so a short first tee just means the round is smaller
+            bytes = static_cast<size_t>(copied);
+            spliceAll(scratch->readFd(), spliceTargets.at(i), bytes);
+        }
+
+        if (lastFromSource) {
+            spliceAll(fd, spliceTargets.back(), bytes);
+            return true;
+        }
+
+        thread_local std::string buff;
+        buff.resize(bytes);
+        size_t offset = 0;
+        while (offset < bytes) {
+            auto chunk = ::read(fd, buff.data() + offset, bytes - offset);
+            if (chunk <= 0) {
+                throw std::runtime_error("Failed to read teed data");
+            }
+            offset += static_cast<size_t>(chunk);
+        }
+        std::string_view data(buff);
+        for (auto* handler : copyTargets) {
+            handler->consume(data);
+        }
+        return true;
+    }
+#endif
+};
+
+/**
+ * ReadHandler that strips ANSI escape sequences from the output, and passes the rest on to another handler. Mainly
+ * useful with PTY mode, where programs tend to assume they can use colours and cursor movement. The downstream handler
+ * must implement ReadHandler::consume().
+ *
+ * Example use:
+ * ```cpp
+ * auto memory = std::make_shared<stc::Unix::InMemoryReadHandler>();
+ * stc::Unix::Process p(
+ *     {"some-command"},
+ *     stc::Unix::createPTY(),
+ *     std::nullopt,
+ *     {},
+ *     stc::Unix::ReadHandlers {
+ *         std::make_shared<stc::Unix::AnsiStripReadHandler>(memory),
+ *         nullptr
+ *     }
+ * );
+ * ```
+ *
+ * \see stc::ansi::AnsiStripper
+ */
+struct AnsiStripReadHandler : public ReadHandler {
+    std::shared_ptr<ReadHandler> downstream;
+    stc::ansi::AnsiStripper stripper;
+
+    AnsiStripReadHandler(const std::shared_ptr<ReadHandler>& downstream) : downstream(downstream) {
+        if (downstream == nullptr) {
+            throw std::runtime_error("AnsiStripReadHandler needs a downstream handler");
+        }
+    }
+
+    virtual void read(
+        LowLevelWrapper* primitive
+    ) override {
+        primitive->readFromFd(
+            [this](std::string_view data) { consume(data); },
+            primitive->readFd()
+        );
+    }
+
+    virtual void consume(std::string_view data) override {
+        stripper.process(data, [this](std::string_view text) {
+            downstream->consume(text);
+        });
+    }
+
+    void flush() override {
+        downstream->flush();
+    }
+};
+
+enum class OutputStream {
+    STDOUT,
+    STDERR,
+};
+
+/**
+ * Append-only record of the output of a process, in the order it was read. Each chunk read from stdout or stderr is
+ * appended to a single arena, alongside a record of which stream it came from, when it was read, and where in the
+ * arena it lives. This preserves both the relative order of stdout and stderr, which Pipes::separate() loses, and
+ * which stream each byte came from, which Pipes::shared() loses.
+ *
+ * The timeline is filled by the ReadHandlers returned by ReadHandlers::timeline(), and must be used with
+ * Pipes::separate(true). Both pipes are polled together, so the order is as precise as the collector thread can make
+ * it; output that has piled up on both streams by the time they're read is ordered stdout first. Timestamps are taken
+ * from std::chrono::steady_clock when the data is read.
+ *
+ * Entries contain views into the arena, which are invalidated when more output is appended. Either iterate after the
+ * process has finished (i.e. after Process::block()), or use forEach(), which holds the lock while iterating.
+ */
+class OutputTimeline {
+public:
+    struct Record {
+        OutputStream stream;
+        std::chrono::steady_clock::time_point timestamp;
+        size_t offset;
+        size_t size;
+    };
+
+    struct Entry {
+        OutputStream stream;
+        std::chrono::steady_clock::time_point timestamp;
+        std::string_view data;
+    };
+
+    /**
+     * Input iterator over the entries. Entries are created on the fly from the records, so dereferencing returns them
+     * by value, which rules out anything stronger than an input iterator.
+     */
+    class Iterator {
+    private:
+        const OutputTimeline* timeline;
+        size_t idx;
+    public:
+        using iterator_category = std::input_iterator_tag;
+        using iterator_concept = std::input_iterator_tag;
+        using value_type = Entry;
+        using difference_type = std::ptrdiff_t;
+        using pointer = void;
+        using reference = Entry;
+
+        Iterator() : timeline(nullptr), idx(0) {}
+        Iterator(const OutputTimeline* timeline, size_t idx) : timeline(timeline), idx(idx) {}
+
+        Entry operator*() const {
+            return timeline->entryAt(idx);
+        }
+        Iterator& operator++() {
+            ++idx;
+            return *this;
+        }
+        Iterator operator++(int) {
+            auto copy = *this;
+            ++idx;
+            return copy;
+        }
+        bool operator==(const Iterator& other) const {
+            return idx == other.idx && timeline == other.timeline;
+        }
+    };
+
+private:
+    mutable std::mutex lock;
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    std::string arena;
+    std::vector<Record> records;
+
+    Entry entryAt(size_t idx) const {
+        const auto& record = records.at(idx);
+        return {
+            record.stream,
+            record.timestamp,
+            std::string_view(arena).substr(record.offset, record.size)
+        };
+    }
+
+    static void escape(std::ostream& out, std::string_view data) {
+        for (auto ch : data) {
+            switch (ch) {
+            case '\\': out << "\\\\"; break;
+            case '\n': out << "\\n"; break;
+            case '\r': out << "\\r"; break;
+            case '\t': out << "\\t"; break;
+            default:
+                if (static_cast<unsigned char>(ch) < 0x20 || ch == 0x7f) {
+                    out << std::format("\\x{:02x}", static_cast<unsigned char>(ch));
+                } else {
+                    out << ch;
+                }
+            }
+        }
+    }
+
+public:
+    void append(OutputStream stream, std::string_view data) {
+        if (data.empty()) {
+            return;
+        }
+        auto now = std::chrono::steady_clock::now();
+        std::lock_guard l(lock);
+        records.push_back({
+            .stream = stream,
+            .timestamp = now,
+            .offset = arena.size(),
+            .size = data.size(),
+        });
+        arena.append(data);
+    }
+
+    /**
+     * \returns the time the timeline was created. Record timestamps are usually interpreted relative to this.
+     */
+    std::chrono::steady_clock::time_point getStartTime() const {
+        return start;
+    }
+
+    /**
+     * \returns the number of records in the timeline.
+     */
+    size_t size() const {
+        std::lock_guard l(lock);
+        return records.size();
+    }
+
+    /**
+     * \returns a copy of the raw records, without the data.
+     */
+    std::vector<Record> getRecords() const {
+        std::lock_guard l(lock);
+        return records;
+    }
+
+    /**
+     * \returns all the output from one stream, concatenated.
+     */
+    std::string getStream(OutputStream stream) const {
+        std::lock_guard l(lock);
+        std::string out;
+        for (const auto& record : records) {
+            if (record.stream == stream) {
+                out.append(arena, record.offset, record.size);
+            }
+        }
+        return out;
+    }
+
+    /**
+     * Calls the callback for each entry in order, while holding the lock. The callback must not call back into the
+     * timeline.
+     */
+    void forEach(const std::function<void(const Entry&)>& callback) const {
+        std::lock_guard l(lock);
+        for (size_t i = 0; i < records.size(); ++i) {
+            callback(entryAt(i));
+        }
+    }
+
+    /**
+     * Not thread-safe; see the class documentation.
+     */
+    Iterator begin() const {
+        return Iterator(this, 0);
+    }
+    Iterator end() const {
+        return Iterator(this, records.size());
+    }
+
+    /**
+     * Writes the timeline as tab-separated values, one record per line:
+     * ```
+     * <microseconds since getStartTime()>\t<stdout|stderr>\t<escaped data>
+     * ```
+     * Backslashes, control characters, and newlines in the data are escaped, so each record is guaranteed to be on a
+     * single line.
+     */
+    void exportTimeline(std::ostream& out) const {
+        std::lock_guard l(lock);
+        for (size_t i = 0; i < records.size(); ++i) {
+            auto entry = entryAt(i);
+            out << std::chrono::duration_cast<std::chrono::microseconds>(entry.timestamp - start).count()
+                << '\t'
+                << (entry.stream == OutputStream::STDOUT ? "stdout" : "stderr")
+                << '\t';
+            escape(out, entry.data);
+            out << '\n';
+        }
+    }
+};
+
+/**
+ * ReadHandler that appends everything it reads to an OutputTimeline. See ReadHandlers::timeline().
+ */
+struct TimelineReadHandler : public ReadHandler {
+    std::shared_ptr<OutputTimeline> timeline;
+    OutputStream stream;
+
+    TimelineReadHandler(const std::shared_ptr<OutputTimeline>& timeline, OutputStream stream)
+        : timeline(timeline), stream(stream) {
+        if (timeline == nullptr) {
+            throw std::runtime_error("TimelineReadHandler needs a timeline");
+        }
+    }
+
+    virtual void read(
+        LowLevelWrapper* primitive
+    ) override {
+        primitive->readFromFd(
+            [this](std::string_view data) { consume(data); },
+            primitive->readFd()
+        );
+    }
+
+    virtual void consume(std::string_view data) override {
+        timeline->append(stream, data);
+    }
+};
+
 struct ReadHandlers {
     std::shared_ptr<ReadHandler> stdoutHandler, stderrHandler;
 
@@ -376,6 +1273,16 @@ struct ReadHandlers {
             .stderrHandler = separateStderr ? std::make_shared<FdRedirectInputHandler>(STDERR_FILENO) : nullptr,
         };
     }
+
+    /**
+     * Creates handlers that record both stdout and stderr into the same timeline. Requires Pipes::separate(true).
+     */
+    static ReadHandlers timeline(const std::shared_ptr<OutputTimeline>& timeline) {
+        return {
+            .stdoutHandler = std::make_shared<TimelineReadHandler>(timeline, OutputStream::STDOUT),
+            .stderrHandler = std::make_shared<TimelineReadHandler>(timeline, OutputStream::STDERR),
+        };
+    }
 };
 
 class Process {
@@ -493,19 +1400,143 @@ protected:
         return data->data();
     }
 
+    /**
+     * Applies the scheduling-related options from the environment to the current process. This must only be called in
+     * the child process, as it exits the process on failure.
+     */
+    static void applySchedulingOptions(const Environment& env) {
+        // This runs between fork() and exec(), so only async-signal-safe functions can be used here. That rules out
+        // iostreams and strerror(), so the message is assembled by hand and written straight to stderr.
+        auto fail = [](const char* what) {
+            int err = errno;
+            char buff[128];
+            size_t len = 0;
+            auto append = [&](const char* str) {
+                while (*str != '\0' && len < sizeof(buff) - 1) {
+                    buff[len++] = *str++;
+                }
+            };
+            append("Failed to set ");
+            append(what);
+            append(": errno ");
+
+            char digits[16];
+            size_t count = 0;
+            unsigned int value = err < 0 ? 0u - static_cast<unsigned int>(err) : static_cast<unsigned int>(err);
+            do {
+                digits[count++] = static_cast<char>('0' + value % 10);
+                value /= 10;
+            } while (value != 0 && count < sizeof(digits));
+            if (err < 0) {
+                append("-");
+            }
+            while (count > 0 && len < sizeof(buff) - 1) {
+                buff[len++] = digits[--count];
+            }
+            buff[len++] = '\n';
+
+            [[maybe_unused]] auto _ = write(STDERR_FILENO, buff, len);
+            _exit(126);
+        };
+
+        // The policy has to be set before the niceness, as switching policies can reset it
+        if (env.schedulingPolicy.has_value()) {
+            int policy = SCHED_OTHER;
+#ifdef __linux__
+            if (*env.schedulingPolicy == SchedulingPolicy::BATCH) {
+                policy = SCHED_BATCH;
+            } else if (*env.schedulingPolicy == SchedulingPolicy::IDLE) {
+                policy = SCHED_IDLE;
+            }
+#endif
+            sched_param param {
+                .sched_priority = 0
+            };
+            if (sched_setscheduler(0, policy, &param) != 0) {
+                fail("scheduling policy");
+            }
+        }
+        if (env.niceness.has_value()) {
+            if (setpriority(PRIO_PROCESS, 0, *env.niceness) != 0) {
+                fail("niceness");
+            }
+        }
+#ifdef __linux__
+        if (env.cpuAffinity.has_value()) {
+            cpu_set_t set;
+            CPU_ZERO(&set);
+            for (auto cpu : *env.cpuAffinity) {
+                CPU_SET(cpu, &set);
+            }
+            if (sched_setaffinity(0, sizeof(set), &set) != 0) {
+                fail("CPU affinity");
+            }
+        }
+        if (env.ioPriority.has_value()) {
+            // Not exposed by glibc, so these are defined manually.
+            // See https://man7.org/linux/man-pages/man2/ioprio_set.2.html
+            constexpr int IOPRIO_WHO_PROCESS = 1;
+            constexpr int IOPRIO_CLASS_SHIFT = 13;
+
+            auto& prio = *env.ioPriority;
+            int level = (prio.ioClass == IOPriorityClass::IDLE || prio.ioClass == IOPriorityClass::NONE)
+                ? 0 : prio.level;
+            if (syscall(
+                SYS_ioprio_set,
+                IOPRIO_WHO_PROCESS,
+                0,
+                (static_cast<int>(prio.ioClass) << IOPRIO_CLASS_SHIFT) | level
+            ) != 0) {
+                fail("I/O priority");
+            }
+        }
+#endif
+    }
+
     void doSpawnCommand(
         const std::vector<std::string>& command,
         const std::function<void()>& readImpl,
         const std::function<void()>& prepDuping,
-        const std::optional<Environment>& env
+        const std::optional<Environment>& inputEnv
     ) {
         if (command.size() == 0) {
             throw std::runtime_error("Cannot run null command");
         }
         std::vector<const char*> convertedCommand;
 
-        if (env) {
-            env->validate();
+        if (inputEnv) {
+            inputEnv->validate();
+        }
+
+        // Shared buffers are exported through the environment, so they need a copy of the environment to put the fd
+        // numbers into. The copy is skipped when there aren't any, as it's otherwise pure overhead.
+        std::optional<Environment> extendedEnv;
+#ifdef __linux__
+        if (inputEnv.has_value() && !inputEnv->sharedBuffers.empty()) {
+            extendedEnv = inputEnv;
+            for (const auto& [name, buffer] : inputEnv->sharedBuffers) {
+                extendedEnv->env[name] = std::to_string(buffer->getFd());
+            }
+        }
+#endif
+        const auto& env = extendedEnv.has_value() ? extendedEnv : inputEnv;
+
+        std::string executable = command.at(0);
+        if (config.searchPath && executable.find('/') == std::string::npos) {
+            std::string path;
+            if (env.has_value() && env->env.contains("PATH")) {
+                path = env->env.at("PATH");
+            } else {
+                path = PathCache::getProcessPath();
+            }
+
+            auto resolved = PathCache::getInstance().resolve(executable, path);
+            if (!resolved.has_value()) {
+                throw std::runtime_error(
+                    std::format("Failed to find {} in PATH", executable)
+                );
+            }
+            executable = resolved->string();
         }
 
         if (config.verboseUserOutput) {
@@ -558,13 +1589,25 @@ protected:
                         env->workingDirectory.value()
                     );
                 }
+                if (env->hasSchedulingOptions()) {
+                    applySchedulingOptions(*env);
+                }
+#ifdef __linux__
+                for (const auto& [_, buffer] : env->sharedBuffers) {
+                    // The buffers are created with CLOEXEC, so it needs to be cleared to make it through exec
+                    fcntl(buffer->getFd(), F_SETFD, 0);
+                }
+#endif
             }
 
             execve(
-                convertedCommand.at(0),
+                executable.c_str(),
                 (char**) convertedCommand.data(),
                 createEnviron(env)
             );
+            // If we get here, exec failed. The child must not return into the caller's code, as that would result in
+            // two copies of the parent running.
+            _exit(127);
         } else {
             // Parent process
             if (readImpl != nullptr) {
@@ -583,6 +1626,43 @@ protected:
         // Read anything left in the buffer at exit time
         readImpl();
     }
+
+    /**
+     * Reads stdout and stderr together, rather than draining one before looking at the other. Each round polls both
+     * fds, and reads at most one bounded chunk from each ready fd, so output that alternates between the streams is
+     * handed to the handlers in roughly the order it arrived. The handlers must implement ReadHandler::consume().
+     */
+    void readInterleaved(Pipe* stdoutPipe, Pipe* stderrPipe) {
+        thread_local std::array<char, 4096> buff;
+        std::array<pollfd, 2> pfds = {{
+            { .fd = stdoutPipe->readFd(), .events = POLLIN, .revents = 0 },
+            { .fd = stderrPipe->readFd(), .events = POLLIN, .revents = 0 },
+        }};
+        std::array<ReadHandler*, 2> handlers = {
+            this->readHandlers.stdoutHandler.get(),
+            this->readHandlers.stderrHandler.get(),
+        };
+
+        // Same timeout as LowLevelWrapper::readFromFd, for the same reason
+        while (poll(pfds.data(), pfds.size(), 10) > 0) {
+            for (size_t i = 0; i < pfds.size(); ++i) {
+                if (pfds[i].revents == 0) {
+                    continue;
+                }
+                ssize_t bytes = ::read(pfds[i].fd, buff.data(), buff.size());
+                if (bytes <= 0) {
+                    // EOF or error; negative fds are ignored by poll, so this stops it from spinning on a hangup
+                    pfds[i].fd = -1;
+                    continue;
+                }
+                std::lock_guard l(lock);
+                handlers[i]->consume(std::string_view(buff.data(), static_cast<size_t>(bytes)));
+            }
+            if (pfds[0].fd < 0 && pfds[1].fd < 0) {
+                break;
+            }
+        }
+    }
 public:
     [[nodiscard("Discarding immediately terminates the process. You probably don't want this")]]
     Process(
@@ -603,8 +1683,18 @@ public:
     ): readHandlers(readHandlers), config(config) {
         interface = pipes;
 
-        doSpawnCommand(command, [this]() {
+        // The relative order of stdout and stderr only matters if both end up in the same place
+        bool interleave = pipes.stdoutPipe != nullptr && pipes.stderrPipe != nullptr
+            && pipes.stdoutPipe != pipes.stderrPipe
+            && std::dynamic_pointer_cast<TimelineReadHandler>(readHandlers.stdoutHandler) != nullptr
+            && std::dynamic_pointer_cast<TimelineReadHandler>(readHandlers.stderrHandler) != nullptr;
+
+        doSpawnCommand(command, [this, interleave]() {
             auto& pipes = std::get<Pipes>(this->interface.value());
+            if (interleave) {
+                readInterleaved(pipes.stdoutPipe.get(), pipes.stderrPipe.get());
+                return;
+            }
             if (pipes.stdoutPipe != nullptr && this->readHandlers.stdoutHandler != nullptr) {
                 std::lock_guard l(lock);
                 this->readHandlers.stdoutHandler->read(pipes.stdoutPipe.get());
@@ -675,7 +1765,7 @@ public:
      * Note that:
      * * If stdout == stderr, stdout may actually be contained in getStderrBuffer instead.
      * * If using a PTY, this also includes some input, as defined by weird PTY internal bullshit that I don't
-     *   understand
+     *   understand. This is the PTY echoing input, and can be turned off with PTYConfig::echo or PTYConfig::raw.
      * * If not using any pipes, or not capturing stdout, this will always be empty
      *
      * \param reset Whether or not to reset the buffer. This can be useful if you want to progressively get output.
@@ -800,6 +1890,19 @@ public:
         signal(SIGKILL);
     }
 
+    /**
+     * Resizes the PTY, and sends SIGWINCH to the process so it can pick up the new size.
+     *
+     * \throws std::runtime_error if not using PTY mode
+     */
+    void resize(unsigned short rows, unsigned short cols) {
+        if (!this->interface.has_value() || !std::holds_alternative<std::shared_ptr<PTY>>(*this->interface)) {
+            throw std::runtime_error("Must use pty mode to use this function");
+        }
+        std::get<std::shared_ptr<PTY>>(*this->interface)->resize(rows, cols);
+        signal(SIGWINCH);
+    }
+
     void closeStdin() {
         if (!this->interface.has_value()) {
             throw std::runtime_error("Must use pipe or pty mode to use this function");
@@ -831,4 +1934,143 @@ public:
 
 };
 
+enum class ShellMode {
+    /**
+     * Always run the command through the shell; equivalent to stc::syscommand(const std::string&, int*).
+     */
+    ALWAYS,
+    /**
+     * Split the command with stc::string::splitShellWords, and run it directly if it doesn't use any shell features.
+     * Falls back to the shell if it does, if the command is a builtin, or if the command can't be found in the PATH.
+     */
+    WHEN_NEEDED,
+};
+
+namespace _detail {
+
+/**
+ * \returns whether or not the word is a reserved word or a builtin that only makes sense inside a shell. Builtins that
+ *          also exist as standalone executables, like `echo` and `test`, are deliberately not included.
+ */
+inline bool isShellOnlyCommand(std::string_view word) {
+    static constexpr std::array<std::string_view, 41> words {
+        // Reserved words
+        "!", "{", "}", "case", "do", "done", "elif", "else", "esac", "fi", "for", "if", "in", "then", "until",
+        "while", "function", "select", "[[", "]]",
+        // Special builtins
+        "break", ":", "continue", ".", "eval", "exec", "exit", "export", "readonly", "return", "set", "shift",
+        "times", "trap", "unset",
+        // Regular builtins that only affect the shell itself
+        "cd", "alias", "unalias", "source", "local", "umask",
+    };
+    return std::find(words.begin(), words.end(), word) != words.end();
+}
+
+/**
+ * ReadHandler used by syscommandDirect(). Reads straight into a string, 64 KiB at a time, rather than going through a
+ * stringstream and LowLevelWrapper's 4 KiB buffer. Commands run through syscommand() tend to be run for their output,
+ * which can be large.
+ */
+struct SyscommandReadHandler : public ReadHandler {
+    static constexpr size_t chunkSize = 1 << 16;
+    std::string output;
+
+    virtual void read(
+        LowLevelWrapper* primitive
+    ) override {
+        pollfd pfd = {
+            .fd = primitive->readFd(),
+            .events = POLLIN,
+            .revents = 0
+        };
+        // Same timeout as LowLevelWrapper::readFromFd, for the same reason
+        while (poll(&pfd, 1, 10) > 0) {
+            size_t size = output.size();
+            output.resize(size + chunkSize);
+            ssize_t bytes = ::read(pfd.fd, output.data() + size, chunkSize);
+            output.resize(size + static_cast<size_t>(std::max<ssize_t>(bytes, 0)));
+            if (bytes <= 0) {
+                break;
+            }
+        }
+    }
+
+    virtual void consume(std::string_view data) override {
+        output.append(data);
+    }
+};
+
+/**
+ * Runs the command without a shell, if possible.
+ *
+ * \returns the output, or std::nullopt if the command has to go through the shell.
+ */
+inline std::optional<std::string> syscommandDirect(const std::string& command, int* codeOutput) {
+    bool requiresShell = false;
+    std::vector<std::string> words;
+    try {
+        words = stc::string::splitShellWords(command, &requiresShell);
+    } catch (const std::runtime_error&) {
+        // Let the shell produce the syntax error
+        return std::nullopt;
+    }
+    if (requiresShell || words.empty() || isShellOnlyCommand(words.front())) {
+        return std::nullopt;
+    }
+
+    auto handler = std::make_shared<SyscommandReadHandler>();
+    std::unique_ptr<Process> process;
+    try {
+        // stdin and stderr are inherited, same as with popen
+        process = std::make_unique<Process>(
+            words,
+            Pipes {
+                .stdoutPipe = createPipe(),
+            },
+            std::nullopt,
+            Config {},
+            ReadHandlers {
+                .stdoutHandler = handler,
+                .stderrHandler = nullptr,
+            }
+        );
+    } catch (const std::runtime_error&) {
+        // Most likely not found in the PATH. The shell gives this the standard error message and exit code
+        return std::nullopt;
+    }
+
+    int statusCode = process->block();
+    if (codeOutput != nullptr) {
+        // Follow the shell convention for processes killed by a signal
+        *codeOutput = process->hasExitedNormally().value_or(true) ? statusCode : 128 + statusCode;
+    }
+    // block() joins the collector thread, so nothing else touches the handler anymore
+    return std::move(handler->output);
+}
+
+}
+
+/**
+ * Variant of stc::syscommand(const std::string&, int*) that can skip the shell.
+ *
+ * With ShellMode::WHEN_NEEDED, simple commands are run directly, which saves a fork and an exec per call. Commands with
+ * pipes, redirects, globs, expansions, or anything else that needs a shell still go through popen. The direct path
+ * differs in subtle ways, such as not producing the shell's error messages for failed execs.
+ *
+ * This is purely an optimisation, and does NOT make it safe to pass user input; anything a user can write that the
+ * tokenizer rejects still ends up in the shell. The same warnings as for stc::syscommand apply.
+ */
+inline std::string syscommand(
+    const std::string& command,
+    int* codeOutput = nullptr,
+    ShellMode mode = ShellMode::WHEN_NEEDED
+) {
+    if (mode == ShellMode::WHEN_NEEDED) {
+        if (auto res = _detail::syscommandDirect(command, codeOutput); res.has_value()) {
+            return *res;
+        }
+    }
+    return stc::syscommand(command, codeOutput);
+}
+
 }
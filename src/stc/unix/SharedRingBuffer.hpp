@@ -0,0 +1,436 @@
+#pragma once
+
+#ifndef __linux__
+#error "SharedRingBuffer.hpp relies on memfd_create and futexes, and is currently Linux only"
+#endif
+
+/** \file
+ *
+ * This file contains a shared memory single producer, single consumer ring buffer, intended for moving bulk data
+ * between a parent and a child process without copying it through a pipe. It's primarily meant to be used with
+ * stc::Unix::Process, which can hand a buffer to a child through stc::Unix::Environment::sharedBuffers, but it works
+ * with anything that can inherit or receive an fd.
+ *
+ * Note that the API used here is not finalised, and is subject to change, including total breakage.
+ */
+
+#include <atomic>
+#include <charconv>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <format>
+#include <linux/futex.h>
+#include <memory>
+#include <optional>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace stc::Unix {
+
+namespace _detail {
+
+/**
+ * The control block placed at the start of the shared mapping. The producer and consumer fields are kept on separate
+ * cache lines to avoid false sharing between the two sides.
+ *
+ * `dataSeq` and `spaceSeq` are futex words. They're bumped whenever data is committed or consumed respectively, and are
+ * only ever used to sleep on.
+ */
+struct SharedRingBufferHeader {
+    uint64_t magic;
+    uint64_t capacity;
+
+    alignas(64) std::atomic<uint64_t> head;
+    std::atomic<uint32_t> dataSeq;
+    std::atomic<uint32_t> consumerWaiting;
+
+    alignas(64) std::atomic<uint64_t> tail;
+    std::atomic<uint32_t> spaceSeq;
+    std::atomic<uint32_t> producerWaiting;
+
+    alignas(64) std::atomic<uint32_t> closed;
+};
+
+static_assert(std::atomic<uint64_t>::is_always_lock_free, "Shared memory atomics must be lock free");
+static_assert(std::atomic<uint32_t>::is_always_lock_free, "Shared memory atomics must be lock free");
+
+constexpr uint64_t SHARED_RING_BUFFER_MAGIC = 0x7374632d72696e67; // "stc-ring"
+
+inline void futexWait(std::atomic<uint32_t>& word, uint32_t expected, std::optional<std::chrono::milliseconds> timeout) {
+    timespec ts {};
+    if (timeout.has_value()) {
+        ts.tv_sec = timeout->count() / 1000;
+        ts.tv_nsec = (timeout->count() % 1000) * 1'000'000;
+    }
+    // Not FUTEX_PRIVATE_FLAG, as the word is shared between processes
+    syscall(
+        SYS_futex,
+        reinterpret_cast<uint32_t*>(&word),
+        FUTEX_WAIT,
+        expected,
+        timeout.has_value() ? &ts : nullptr,
+        nullptr,
+        0
+    );
+}
+
+inline void futexWake(std::atomic<uint32_t>& word) {
+    syscall(
+        SYS_futex,
+        reinterpret_cast<uint32_t*>(&word),
+        FUTEX_WAKE,
+        1,
+        nullptr,
+        nullptr,
+        0
+    );
+}
+
+}
+
+/**
+ * Single producer, single consumer byte ring buffer backed by a memfd, for use across processes.
+ *
+ * The data region is mapped twice back-to-back, so any readable or writable range is always contiguous in memory, even
+ * when it wraps around the end of the buffer. This means both sides can work directly on the shared memory through
+ * reserve()/commit() and peek()/consume() without any intermediate copies. Sleeping and waking is done with futexes in
+ * the shared mapping, so a side only makes a syscall when it actually has to wait, or has to wake up a waiting peer.
+ *
+ * Exactly one process (or thread) may act as the producer, and exactly one as the consumer. Nothing enforces this, so
+ * breaking it results in corrupt data.
+ *
+ * Example use:
+ * ```cpp
+ * // Parent
+ * auto buffer = stc::Unix::createSharedRingBuffer(1 << 20);
+ * stc::Unix::Process p({"worker"}, stc::Unix::Pipes::separate(), stc::Unix::Environment {
+ *     .sharedBuffers = {{"WORKER_INPUT", buffer}}
+ * });
+ * buffer->write("some bulk data");
+ * buffer->closeWrite();
+ *
+ * // Child
+ * auto buffer = stc::Unix::SharedRingBuffer::fromEnv("WORKER_INPUT");
+ * while (true) {
+ *     auto data = buffer->peek();
+ *     if (data.empty()) break; // EOF
+ *     process(data);
+ *     buffer->consume(data.size());
+ * }
+ * ```
+ */
+class SharedRingBuffer {
+private:
+    int fd = -1;
+    size_t headerSize = 0;
+    size_t capacity = 0;
+
+    char* mapping = nullptr;
+    size_t mappingSize = 0;
+
+    _detail::SharedRingBufferHeader* header = nullptr;
+    char* data = nullptr;
+
+    static size_t getPageSize() {
+        static size_t pageSize = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+        return pageSize;
+    }
+
+    void map() {
+        mappingSize = headerSize + 2 * capacity;
+        // Reserve the full address range first, so the two data mappings are guaranteed to be adjacent
+        void* reserved = mmap(nullptr, mappingSize, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (reserved == MAP_FAILED) {
+            throw std::runtime_error("Failed to reserve memory for SharedRingBuffer");
+        }
+        mapping = static_cast<char*>(reserved);
+
+        if (mmap(
+                mapping, headerSize + capacity,
+                PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED,
+                fd, 0
+            ) == MAP_FAILED
+            || mmap(
+                mapping + headerSize + capacity, capacity,
+                PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED,
+                fd, static_cast<off_t>(headerSize)
+            ) == MAP_FAILED
+        ) {
+            throw std::runtime_error("Failed to map SharedRingBuffer");
+        }
+
+        header = reinterpret_cast<_detail::SharedRingBufferHeader*>(mapping);
+        data = mapping + headerSize;
+    }
+
+    void unmap() {
+        if (mapping != nullptr) {
+            munmap(mapping, mappingSize);
+            mapping = nullptr;
+        }
+        if (fd >= 0) {
+            close(fd);
+            fd = -1;
+        }
+    }
+
+    SharedRingBuffer() = default;
+
+public:
+    /**
+     * Creates a new buffer.
+     *
+     * \param requestedCapacity The minimum capacity of the buffer in bytes. Rounded up to the nearest multiple of the
+     *                          page size.
+     * \throws std::runtime_error if the memfd cannot be created or mapped.
+     */
+    explicit SharedRingBuffer(size_t requestedCapacity) {
+        if (requestedCapacity == 0) {
+            throw std::runtime_error("SharedRingBuffer capacity must be non-zero");
+        }
+        auto pageSize = getPageSize();
+        headerSize = pageSize;
+        capacity = (requestedCapacity + pageSize - 1) / pageSize * pageSize;
+
+        // CLOEXEC so the fd doesn't leak into unrelated children. Process clears it for the children it's passed to.
+        fd = static_cast<int>(syscall(SYS_memfd_create, "stc-shared-ring-buffer", MFD_CLOEXEC));
+        if (fd < 0) {
+            throw std::runtime_error(std::format("Failed to create memfd: {}", strerror(errno)));
+        }
+        if (ftruncate(fd, static_cast<off_t>(headerSize + capacity)) != 0) {
+            close(fd);
+            throw std::runtime_error(std::format("Failed to size memfd: {}", strerror(errno)));
+        }
+        try {
+            map();
+        } catch (...) {
+            unmap();
+            throw;
+        }
+
+        // The memfd is zero-filled, so the atomics are already 0
+        header->magic = _detail::SHARED_RING_BUFFER_MAGIC;
+        header->capacity = capacity;
+    }
+
+    SharedRingBuffer(const SharedRingBuffer&) = delete;
+    SharedRingBuffer& operator=(const SharedRingBuffer&) = delete;
+
+    ~SharedRingBuffer() {
+        unmap();
+    }
+
+    /**
+     * Attaches to an existing buffer, usually one inherited from a parent process. The returned object takes ownership
+     * of the fd.
+     *
+     * \throws std::runtime_error if the fd does not refer to a SharedRingBuffer
+     */
+    static std::shared_ptr<SharedRingBuffer> fromFd(int fd) {
+        std::shared_ptr<SharedRingBuffer> out(new SharedRingBuffer());
+        out->fd = fd;
+        out->headerSize = getPageSize();
+
+        struct stat st;
+        if (fstat(fd, &st) != 0 || static_cast<size_t>(st.st_size) <= out->headerSize) {
+            throw std::runtime_error("fd is not a SharedRingBuffer");
+        }
+        out->capacity = static_cast<size_t>(st.st_size) - out->headerSize;
+        out->map();
+
+        if (out->header->magic != _detail::SHARED_RING_BUFFER_MAGIC || out->header->capacity != out->capacity) {
+            throw std::runtime_error("fd is not a SharedRingBuffer");
+        }
+        // The inherited fd is not CLOEXEC; make sure it doesn't propagate any further
+        fcntl(fd, F_SETFD, FD_CLOEXEC);
+        return out;
+    }
+
+    /**
+     * Attaches to a buffer whose fd is stored in an environment variable. This is how buffers passed through
+     * stc::Unix::Environment::sharedBuffers are received.
+     *
+     * \throws std::runtime_error if the variable is undefined, isn't a valid fd, or doesn't refer to a SharedRingBuffer
+     */
+    static std::shared_ptr<SharedRingBuffer> fromEnv(const char* name) {
+        const char* value = std::getenv(name);
+        if (value == nullptr) {
+            throw std::runtime_error(std::format("{} is not defined", name));
+        }
+        std::string_view str(value);
+        int parsed = -1;
+        auto [end, ec] = std::from_chars(str.data(), str.data() + str.size(), parsed);
+        if (ec != std::errc{} || end != str.data() + str.size() || parsed < 0) {
+            throw std::runtime_error(std::format("{} does not contain a valid fd: {}", name, str));
+        }
+        return fromFd(parsed);
+    }
+
+    int getFd() const {
+        return fd;
+    }
+
+    size_t getCapacity() const {
+        return capacity;
+    }
+
+    /**
+     * \returns the number of bytes currently available for reading.
+     */
+    size_t available() const {
+        return header->head.load(std::memory_order_acquire) - header->tail.load(std::memory_order_acquire);
+    }
+
+    /**
+     * Producer only. Reserves space for `size` bytes, blocking until enough space is free. The returned span points
+     * directly into the shared memory, and is not visible to the consumer until commit() is called.
+     *
+     * \param size      The number of bytes to reserve. Must not exceed the capacity.
+     * \param timeout   The maximum amount of time to wait per wakeup. If std::nullopt, waits indefinitely.
+     * \returns         The reserved range, or an empty span if the wait timed out.
+     * \throws std::runtime_error if size > capacity
+     */
+    std::span<char> reserve(size_t size, std::optional<std::chrono::milliseconds> timeout = std::nullopt) {
+        if (size > capacity) {
+            throw std::runtime_error(std::format("Cannot reserve {} bytes in a buffer of size {}", size, capacity));
+        }
+        auto head = header->head.load(std::memory_order_relaxed);
+        while (capacity - (head - header->tail.load(std::memory_order_acquire)) < size) {
+            auto seq = header->spaceSeq.load(std::memory_order_acquire);
+            header->producerWaiting.store(1, std::memory_order_seq_cst);
+            if (capacity - (head - header->tail.load(std::memory_order_seq_cst)) >= size) {
+                header->producerWaiting.store(0, std::memory_order_relaxed);
+                break;
+            }
+            _detail::futexWait(header->spaceSeq, seq, timeout);
+            header->producerWaiting.store(0, std::memory_order_relaxed);
+            if (timeout.has_value() && capacity - (head - header->tail.load(std::memory_order_acquire)) < size) {
+                return {};
+            }
+        }
+        return { data + (head % capacity), size };
+    }
+
+    /**
+     * Producer only. Publishes `size` bytes previously reserved with reserve().
+     */
+    void commit(size_t size) {
+        header->head.fetch_add(size, std::memory_order_release);
+        header->dataSeq.fetch_add(1, std::memory_order_seq_cst);
+        if (header->consumerWaiting.load(std::memory_order_seq_cst) != 0) {
+            _detail::futexWake(header->dataSeq);
+        }
+    }
+
+    /**
+     * Producer only. Copies data into the buffer, blocking as needed. Data larger than the capacity is written in
+     * several chunks.
+     */
+    void write(std::string_view in) {
+        while (!in.empty()) {
+            auto chunk = std::min(in.size(), capacity);
+            auto span = reserve(chunk);
+            std::memcpy(span.data(), in.data(), chunk);
+            commit(chunk);
+            in.remove_prefix(chunk);
+        }
+    }
+
+    /**
+     * Producer only. Marks the end of the data. Once the consumer has read everything already committed, peek() returns
+     * an empty span.
+     */
+    void closeWrite() {
+        header->closed.store(1, std::memory_order_release);
+        header->dataSeq.fetch_add(1, std::memory_order_seq_cst);
+        _detail::futexWake(header->dataSeq);
+    }
+
+    /**
+     * \returns true if the producer has called closeWrite() and all data has been consumed.
+     */
+    bool isEOF() const {
+        return header->closed.load(std::memory_order_acquire) != 0 && available() == 0;
+    }
+
+    /**
+     * Consumer only. Returns all the data currently available, blocking until at least one byte is available. The
+     * returned span points directly into the shared memory, and stays valid until consume() is called.
+     *
+     * \param timeout   The maximum amount of time to wait per wakeup. If std::nullopt, waits indefinitely.
+     * \returns         The readable range, or an empty span on EOF or if the wait timed out. Use isEOF() to tell the
+     *                  two apart.
+     */
+    std::span<const char> peek(std::optional<std::chrono::milliseconds> timeout = std::nullopt) {
+        while (available() == 0) {
+            if (header->closed.load(std::memory_order_acquire) != 0) {
+                // Closing happens after the last commit, but re-check to avoid racing with it
+                if (available() == 0) {
+                    return {};
+                }
+                break;
+            }
+            auto seq = header->dataSeq.load(std::memory_order_acquire);
+            header->consumerWaiting.store(1, std::memory_order_seq_cst);
+            if (available() != 0 || header->closed.load(std::memory_order_seq_cst) != 0) {
+                header->consumerWaiting.store(0, std::memory_order_relaxed);
+                continue;
+            }
+            _detail::futexWait(header->dataSeq, seq, timeout);
+            header->consumerWaiting.store(0, std::memory_order_relaxed);
+            if (timeout.has_value() && available() == 0) {
+                return {};
+            }
+        }
+        auto tail = header->tail.load(std::memory_order_relaxed);
+        return { data + (tail % capacity), available() };
+    }
+
+    /**
+     * Consumer only. Releases `size` bytes previously returned by peek(), making the space available to the producer
+     * again.
+     */
+    void consume(size_t size) {
+        header->tail.fetch_add(size, std::memory_order_release);
+        header->spaceSeq.fetch_add(1, std::memory_order_seq_cst);
+        if (header->producerWaiting.load(std::memory_order_seq_cst) != 0) {
+            _detail::futexWake(header->spaceSeq);
+        }
+    }
+
+    /**
+     * Consumer only. Reads everything until the producer closes the buffer. Convenience wrapper around peek() and
+     * consume() for when zero-copy access isn't needed.
+     */
+    std::string readAll() {
+        std::string out;
+        while (true) {
+            auto span = peek();
+            if (span.empty()) {
+                break;
+            }
+            out.append(span.data(), span.size());
+            consume(span.size());
+        }
+        return out;
+    }
+};
+
+/**
+ * Shorthand for creating a new SharedRingBuffer. Saves a few characters, does nothing special aside calling
+ * std::make_shared
+ */
+inline std::shared_ptr<SharedRingBuffer> createSharedRingBuffer(size_t capacity) {
+    return std::make_shared<SharedRingBuffer>(capacity);
+}
+
+}
@@ -0,0 +1,366 @@
+#pragma once
+
+/** \file
+ *
+ * This file contains a pool of long-lived worker processes that communicate over stdin and stdout, built on
+ * stc::Unix::Process. It's intended for "server" style tools that accept one request per line or frame, where spawning
+ * a new process per request would spend most of its time on exec and startup.
+ *
+ * Note that the API used here is not finalised, and is subject to change, including total breakage.
+ */
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <csignal>
+#include <cstdint>
+#include <deque>
+#include <format>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <pthread.h>
+#include <string>
+#include <vector>
+
+#include "Process.hpp"
+
+namespace stc::Unix {
+
+enum class FramingMode {
+    /**
+     * Each frame is terminated by `\n`. Requests cannot contain `\n`, and the `\n` is not included in responses.
+     */
+    NEWLINE,
+    /**
+     * Each frame is prefixed by its length as a 4 byte, big endian unsigned integer. Frames can contain arbitrary
+     * binary data.
+     */
+    LENGTH_PREFIXED,
+};
+
+/**
+ * ReadHandler that splits the output into frames, and queues up complete frames until they're consumed with
+ * waitForFrame().
+ */
+struct FramedReadHandler : public ReadHandler {
+    FramingMode mode;
+
+    std::mutex frameLock;
+    std::condition_variable frameNotifier;
+    std::deque<std::string> frames;
+    /**
+     * Data that has been read, but that doesn't form a full frame yet.
+     */
+    std::string pending;
+
+    FramedReadHandler(FramingMode mode) : mode(mode) {}
+
+    virtual void read(
+        LowLevelWrapper* primitive
+    ) override {
+        primitive->readFromFd(
+            [this](std::string_view data) { consume(data); },
+            primitive->readFd()
+        );
+    }
+
+    virtual void consume(std::string_view data) override {
+        std::lock_guard l(frameLock);
+        pending.append(data);
+
+        bool found = false;
+        if (mode == FramingMode::NEWLINE) {
+            size_t start = 0;
+            size_t end;
+            while ((end = pending.find('\n', start)) != std::string::npos) {
+                frames.emplace_back(pending, start, end - start);
+                start = end + 1;
+                found = true;
+            }
+            pending.erase(0, start);
+        } else {
+            size_t start = 0;
+            while (pending.size() - start >= 4) {
+                auto* header = reinterpret_cast<const unsigned char*>(pending.data() + start);
+                uint32_t size = (uint32_t(header[0]) << 24)
+                    | (uint32_t(header[1]) << 16)
+                    | (uint32_t(header[2]) << 8)
+                    | uint32_t(header[3]);
+                if (pending.size() - start - 4 < size) {
+                    break;
+                }
+                frames.emplace_back(pending, start + 4, size);
+                start += 4 + size;
+                found = true;
+            }
+            pending.erase(0, start);
+        }
+
+        if (found) {
+            frameNotifier.notify_all();
+        }
+    }
+
+    /**
+     * Waits for a frame until the deadline.
+     *
+     * \returns the oldest unconsumed frame, or std::nullopt if the deadline was reached first.
+     */
+    std::optional<std::string> waitForFrame(std::chrono::steady_clock::time_point deadline) {
+        std::unique_lock l(frameLock);
+        if (!frameNotifier.wait_until(l, deadline, [this]() { return !frames.empty(); })) {
+            return std::nullopt;
+        }
+        auto frame = std::move(frames.front());
+        frames.pop_front();
+        return frame;
+    }
+
+    /**
+     * Encodes a request according to the framing mode.
+     *
+     * \throws std::runtime_error if the request cannot be represented with the framing mode.
+     */
+    static std::string encode(FramingMode mode, const std::string& request) {
+        if (mode == FramingMode::NEWLINE) {
+            if (request.find('\n') != std::string::npos) {
+                throw std::runtime_error("Newline-framed requests cannot contain newlines");
+            }
+            return request + "\n";
+        }
+
+        if (request.size() > UINT32_MAX) {
+            throw std::runtime_error("Request too large for a length-prefixed frame");
+        }
+        auto size = static_cast<uint32_t>(request.size());
+        std::string out;
+        out.reserve(request.size() + 4);
+        out.push_back(static_cast<char>((size >> 24) & 0xff));
+        out.push_back(static_cast<char>((size >> 16) & 0xff));
+        out.push_back(static_cast<char>((size >> 8) & 0xff));
+        out.push_back(static_cast<char>(size & 0xff));
+        out += request;
+        return out;
+    }
+};
+
+struct WorkerPoolConfig {
+    FramingMode framing = FramingMode::NEWLINE;
+
+    /**
+     * The default time a request is allowed to take, counted from when a worker has been picked. If a worker doesn't
+     * respond in time, it's killed and replaced, as there's no way to know if it'll eventually respond to the old
+     * request.
+     */
+    std::chrono::milliseconds timeout = std::chrono::seconds(30);
+
+    /**
+     * Environment for the workers.
+     */
+    std::optional<Environment> env = std::nullopt;
+
+    Config processConfig = {};
+};
+
+/**
+ * Pool of persistent worker processes. Each worker is a stc::Unix::Process running the same command, with stdin and
+ * stdout connected to pipes. Requests are dispatched to idle workers over stdin, and the response is the next frame
+ * the worker writes to stdout. stderr is not captured, and goes to the parent's stderr.
+ *
+ * Workers that exit, crash, or time out are transparently replaced. A request that was in flight when this happened
+ * fails with an exception, but the pool itself stays usable.
+ *
+ * submit() is thread-safe, and can be called from as many threads as there are workers to make full use of the pool.
+ *
+ * Example use:
+ * ```cpp
+ * stc::Unix::WorkerPool pool({"some-server-tool", "--stdio"}, 4);
+ * std::string response = pool.submit("some request");
+ * ```
+ *
+ * Note that writes to stdin block, so a worker that stops reading its input without exiting can block submit() past
+ * the timeout if the request is larger than the pipe buffer.
+ */
+class WorkerPool {
+private:
+    struct Worker {
+        std::unique_ptr<Process> process;
+        std::shared_ptr<FramedReadHandler> handler;
+    };
+
+    std::vector<std::string> command;
+    WorkerPoolConfig config;
+
+    std::mutex lock;
+    std::condition_variable idleNotifier;
+    std::vector<Worker> workers;
+    std::vector<size_t> idle;
+
+    std::atomic<size_t> restarts = 0;
+
+    Worker spawn() {
+        auto handler = std::make_shared<FramedReadHandler>(config.framing);
+        auto process = std::make_unique<Process>(
+            command,
+            Pipes {
+                .stdoutPipe = createPipe(),
+                .stdinPipe = createPipe(),
+            },
+            config.env,
+            config.processConfig,
+            ReadHandlers {
+                .stdoutHandler = handler,
+                .stderrHandler = nullptr,
+            }
+        );
+        return { std::move(process), handler };
+    }
+
+    void restart(Worker& worker) {
+        // The Process destructor kills and reaps the old worker
+        worker = spawn();
+        restarts++;
+    }
+
+    size_t acquire() {
+        std::unique_lock l(lock);
+        idleNotifier.wait(l, [this]() { return !idle.empty(); });
+        auto idx = idle.back();
+        idle.pop_back();
+        return idx;
+    }
+
+    void release(size_t idx) {
+        {
+            std::lock_guard l(lock);
+            idle.push_back(idx);
+        }
+        idleNotifier.notify_one();
+    }
+
+    /**
+     * Writes to the worker's stdin without letting a SIGPIPE from a dead worker kill the current process.
+     */
+    static bool writeFrame(Process& process, const std::string& frame) {
+        sigset_t pipeSet, oldSet;
+        sigemptyset(&pipeSet);
+        sigaddset(&pipeSet, SIGPIPE);
+        pthread_sigmask(SIG_BLOCK, &pipeSet, &oldSet);
+
+        ssize_t written = 0;
+        try {
+            written = process.writeToStdin(frame);
+        } catch (const std::runtime_error&) {
+            written = -1;
+        }
+
+        // If the write did trigger a SIGPIPE, it's pending on this thread, and has to be eaten before the signal is
+        // unblocked
+        timespec noWait {};
+        while (sigtimedwait(&pipeSet, nullptr, &noWait) == SIGPIPE) {}
+        pthread_sigmask(SIG_SETMASK, &oldSet, nullptr);
+
+        return written == static_cast<ssize_t>(frame.size());
+    }
+
+public:
+    /**
+     * \param command   The command to run for each worker.
+     * \param count     The number of workers to keep alive. All workers are started immediately.
+     * \param config    Additional configuration for the pool.
+     */
+    [[nodiscard("Discarding immediately terminates the workers. You probably don't want this")]]
+    WorkerPool(
+        const std::vector<std::string>& command,
+        size_t count,
+        const WorkerPoolConfig& config = {}
+    ) : command(command), config(config) {
+        if (count == 0) {
+            throw std::runtime_error("WorkerPool needs at least one worker");
+        }
+        workers.reserve(count);
+        for (size_t i = 0; i < count; ++i) {
+            workers.push_back(spawn());
+            idle.push_back(i);
+        }
+    }
+
+    /**
+     * Sends a request to an idle worker and waits for its response. Blocks until a worker is available.
+     *
+     * \param request   The request, without framing; framing is added according to WorkerPoolConfig::framing
+     * \param timeout   The time to wait for a response. If std::nullopt, WorkerPoolConfig::timeout is used.
+     * \returns         The response, without framing.
+     * \throws std::runtime_error if the worker died or timed out before responding, or if the request can't be framed.
+     *         The worker is replaced in both cases.
+     */
+    std::string submit(
+        const std::string& request,
+        std::optional<std::chrono::milliseconds> timeout = std::nullopt
+    ) {
+        auto frame = FramedReadHandler::encode(config.framing, request);
+        auto idx = acquire();
+        // acquire() hands out exclusive ownership of the worker, so it can be used without holding the lock.
+        auto& worker = workers.at(idx);
+
+        try {
+            if (worker.process->getExitCode().has_value()) {
+                restart(worker);
+            }
+
+            if (!writeFrame(*worker.process, frame)) {
+                restart(worker);
+                throw std::runtime_error("Worker died before the request could be sent");
+            }
+
+            auto deadline = std::chrono::steady_clock::now() + timeout.value_or(config.timeout);
+            while (true) {
+                // Wake up periodically to check whether the worker is still alive
+                auto slice = std::min(
+                    deadline,
+                    std::chrono::steady_clock::now() + std::chrono::milliseconds(50)
+                );
+                if (auto response = worker.handler->waitForFrame(slice); response.has_value()) {
+                    release(idx);
+                    return *response;
+                }
+
+                if (worker.process->getExitCode().has_value()) {
+                    // The worker may have written a response right before exiting. block() waits for the last read
+                    worker.process->block();
+                    auto response = worker.handler->waitForFrame(std::chrono::steady_clock::now());
+                    restart(worker);
+                    if (response.has_value()) {
+                        release(idx);
+                        return *response;
+                    }
+                    throw std::runtime_error("Worker exited before responding");
+                }
+                if (std::chrono::steady_clock::now() >= deadline) {
+                    restart(worker);
+                    throw std::runtime_error("Worker timed out");
+                }
+            }
+        } catch (...) {
+            release(idx);
+            throw;
+        }
+    }
+
+    /**
+     * \returns the number of workers in the pool.
+     */
+    size_t size() const {
+        return workers.size();
+    }
+
+    /**
+     * \returns the number of times a worker has been replaced since the pool was created.
+     */
+    size_t getRestartCount() const {
+        return restarts;
+    }
+};
+
+}
@@ -0,0 +1,62 @@
+#include <catch2/catch_test_macros.hpp>
+
+#include <stc/AnsiParser.hpp>
+#include <string>
+#include <vector>
+
+TEST_CASE("AnsiStripper should strip escape sequences", "[AnsiParser]") {
+    REQUIRE(stc::ansi::strip("plain text\n") == "plain text\n");
+    REQUIRE(stc::ansi::strip("\033[1;31mred\033[0m text") == "red text");
+    REQUIRE(stc::ansi::strip("a\033[2Kb\033[?25lc") == "abc");
+    // OSC, terminated by BEL and by ST
+    REQUIRE(stc::ansi::strip("\033]0;title\007a\033]8;;https://example.com\033\\link\033]8;;\033\\") == "alink");
+    // Two-byte and intermediate sequences
+    REQUIRE(stc::ansi::strip("a\033=b\033(Bc") == "abc");
+    // A string cut off by a new sequence
+    REQUIRE(stc::ansi::strip("\033]0;title\033[31mred") == "red");
+    REQUIRE(stc::ansi::strip("tabs\tand\r\nnewlines") == "tabs\tand\r\nnewlines");
+}
+
+TEST_CASE("AnsiStripper should handle sequences split across chunks", "[AnsiParser]") {
+    std::string input = "one \033[38;2;255;0;0mtwo\033]0;some title\007 three\033[0m\033(B four";
+    std::string expected = "one two three four";
+
+    // Every possible split point, for two chunks
+    for (size_t split = 0; split <= input.size(); ++split) {
+        stc::ansi::AnsiStripper stripper;
+        std::string out;
+        stripper.process(std::string_view(input).substr(0, split), out);
+        stripper.process(std::string_view(input).substr(split), out);
+        INFO(split);
+        REQUIRE(out == expected);
+        REQUIRE_FALSE(stripper.isInSequence());
+    }
+
+    // One byte at a time
+    stc::ansi::AnsiStripper stripper;
+    std::string out;
+    for (char ch : input) {
+        stripper.process(std::string_view(&ch, 1), out);
+    }
+    REQUIRE(out == expected);
+}
+
+TEST_CASE("Display width should be computed correctly", "[AnsiParser]") {
+    REQUIRE(stc::ansi::displayWidth("") == 0);
+    REQUIRE(stc::ansi::displayWidth("a longer string that's over sixteen bytes") == 41);
+    REQUIRE(stc::ansi::displayWidth("short\na much longer line\nmid") == 18);
+    REQUIRE(stc::ansi::displayWidth("a\tb") == 9);
+    REQUIRE(stc::ansi::displayWidth("blåbærsyltetøy") == 14);
+    REQUIRE(stc::ansi::displayWidth("日本語") == 6);
+    REQUIRE(stc::ansi::displayWidth("e\xcc\x81") == 1);
+    REQUIRE(stc::ansi::visibleWidth("\033[1;31m日本語\033[0m text") == 11);
+
+    SECTION("Split UTF-8") {
+        std::string text = "æøå日本";
+        stc::ansi::DisplayWidthCounter counter;
+        for (char ch : text) {
+            counter.add(std::string_view(&ch, 1));
+        }
+        REQUIRE(counter.getWidth() == 7);
+    }
+}
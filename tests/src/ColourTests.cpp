@@ -1,7 +1,14 @@
 #include <catch2/catch_test_macros.hpp>
 
+#include <map>
 #include <sstream>
 #include <stc/Colour.hpp>
+#include <stc/test/CaptureStream.hpp>
+
+#if !defined(_WIN32) && !defined(__APPLE__)
+#include <pty.h>
+#include <unistd.h>
+#endif
 using namespace stc;
 
 TEST_CASE("Forcing allows std::stringstream to contain ANSI") {
@@ -35,3 +42,216 @@ TEST_CASE("Forcing allows std::stringstream to contain ANSI") {
         REQUIRE(ss.str().ends_with("Normal text"));
     }
 }
+
+TEST_CASE("Escape sequences should be formatted correctly", "[Colour]") {
+    std::stringstream ss;
+    ss << colour::force;
+    SECTION("Four bit") {
+        ss << colour::fg<colour::FourBitColour::BRIGHT_RED> << colour::bg<colour::FourBitColour::BLACK>;
+        REQUIRE(ss.str() == "\033[91m\033[40m");
+    }
+    SECTION("Eight bit") {
+        ss << colour::fg<240> << colour::bg<7> << colour::fg<0>;
+        REQUIRE(ss.str() == "\033[38;5;240m\033[48;5;7m\033[38;5;0m");
+    }
+    SECTION("Truecolour") {
+        ss << colour::fg<255, 0, 42> << colour::bg<1, 20, 100>;
+        REQUIRE(ss.str() == "\033[38;2;255;0;42m\033[48;2;1;20;100m");
+    }
+    SECTION("Typography and reset") {
+        ss << colour::use<colour::Typography::BOLD> << colour::reset;
+        REQUIRE(ss.str() == "\033[1m\033[0m");
+    }
+    SECTION("Wide streams") {
+        std::wstringstream wss;
+        wss << colour::force << colour::fg<240> << L"owo" << colour::reset;
+        REQUIRE(wss.str() == L"\033[38;5;240mowo\033[0m");
+    }
+}
+
+#if !defined(_WIN32) && !defined(__APPLE__)
+TEST_CASE("TTY detection should be cached until refreshed", "[Colour]") {
+    int master, slave;
+    REQUIRE(openpty(&master, &slave, nullptr, nullptr, nullptr) == 0);
+    std::cout << std::flush;
+    int originalStdout = dup(STDOUT_FILENO);
+    REQUIRE(originalStdout >= 0);
+    bool wasTTY = isatty(STDOUT_FILENO);
+
+    auto colouredOutput = [&]() {
+        stc::testutil::CaptureStream c(std::cout);
+        std::cout << colour::fg<colour::FourBitColour::RED> << "owo" << colour::reset;
+        return c.content.str();
+    };
+
+    // Turn stdout into a TTY, and let the cache pick it up
+    dup2(slave, STDOUT_FILENO);
+    std::cout << colour::refresh;
+    auto whileTTY = colouredOutput();
+
+    // Turn it back into whatever it was. The cache keeps the old value until refreshed
+    dup2(originalStdout, STDOUT_FILENO);
+    auto cached = colouredOutput();
+    std::cout << colour::refresh;
+    auto refreshed = colouredOutput();
+
+    close(originalStdout);
+    close(slave);
+    close(master);
+
+    REQUIRE(whileTTY == "\033[31mowo\033[0m");
+    REQUIRE(cached == whileTTY);
+    REQUIRE(refreshed == (wasTTY ? whileTTY : "owo"));
+}
+#endif
+
+TEST_CASE("Styled values should work with std::format", "[Colour]") {
+    using namespace std::literals;
+    SECTION("Combined styles") {
+        auto res = std::format(
+            "{} {}",
+            colour::styled(
+                "error"sv,
+                colour::foreground(colour::FourBitColour::RED),
+                colour::background(240),
+                colour::Typography::BOLD,
+                colour::Typography::UNDERLINE
+            ),
+            colour::styled(42, colour::foreground(1, 20, 255))
+        );
+        REQUIRE(res == "\033[1;4;31;48;5;240merror\033[0m \033[38;2;1;20;255m42\033[0m");
+    }
+    SECTION("Format specs apply to the value") {
+        auto res = std::format("{:>4}|", colour::styled(42, colour::background(colour::FourBitColour::BLUE)));
+        REQUIRE(res == "\033[44m  42\033[0m|");
+    }
+    SECTION("Empty styles are no-ops") {
+        REQUIRE(std::format("{}", colour::styled(42)) == "42");
+    }
+    SECTION("Output targets") {
+        std::stringstream ss;
+        auto plain = colour::OutputTarget::of(ss);
+        REQUIRE(std::format("{}", plain.styled(42, colour::Typography::BOLD)) == "42");
+
+        ss << colour::force;
+        auto forced = colour::OutputTarget::of(ss);
+        REQUIRE(std::format("{}", forced.styled(42, colour::Typography::BOLD)) == "\033[1m42\033[0m");
+    }
+}
+
+TEST_CASE("Runtime styles should match the compile-time sequences", "[Colour]") {
+    auto render = [](const colour::Style& style) {
+        return std::string(style.render().view());
+    };
+    REQUIRE(render({}) == "");
+    REQUIRE(render(colour::Style::of(colour::foreground(colour::FourBitColour::BRIGHT_RED))) == "\033[91m");
+    REQUIRE(render(colour::Style::of(colour::background(colour::FourBitColour::BLACK))) == "\033[40m");
+    for (int i = 0; i < 256; ++i) {
+        auto code = static_cast<uint8_t>(i);
+        INFO(i);
+        REQUIRE(render(colour::Style::of(colour::foreground(code))) == "\033[38;5;" + std::to_string(i) + "m");
+        REQUIRE(render(colour::Style::of(colour::background(code))) == "\033[48;5;" + std::to_string(i) + "m");
+    }
+    REQUIRE(
+        render(colour::Style::of(
+            colour::Typography::BOLD,
+            colour::Typography::UNDERLINE,
+            colour::foreground(255, 0, 42),
+            colour::background(1, 20, 100)
+        )) == "\033[1;4;38;2;255;0;42;48;2;1;20;100m"
+    );
+
+    // Worst case, to make sure the inline buffer is large enough
+    colour::Style everything = colour::Style::of(colour::foreground(255, 255, 255), colour::background(255, 255, 255));
+    everything.typography = UINT32_MAX;
+    auto rendered = render(everything);
+    REQUIRE(rendered.starts_with("\033[0;1;2;"));
+    REQUIRE(rendered.ends_with(";31;38;2;255;255;255;48;2;255;255;255m"));
+}
+
+TEST_CASE("Runtime styles should be streamable", "[Colour]") {
+    auto style = colour::Style::of(colour::foreground(240), colour::Typography::BOLD);
+    std::stringstream ss;
+    SECTION("Without colour") {
+        ss << style << "owo" << colour::reset;
+        REQUIRE(ss.str() == "owo");
+    }
+    SECTION("Forced") {
+        ss << colour::force << style << "owo" << colour::reset;
+        REQUIRE(ss.str() == "\033[1;38;5;240mowo\033[0m");
+    }
+    SECTION("Wide streams") {
+        std::wstringstream wss;
+        wss << colour::force << style << L"owo" << colour::reset;
+        REQUIRE(wss.str() == L"\033[1;38;5;240mowo\033[0m");
+    }
+}
+
+TEST_CASE("Colour depth should be detected from the environment", "[Colour]") {
+    auto detect = [](std::map<std::string, std::string> env) {
+        return colour::detectColourDepth([&](const char* name) -> const char* {
+            auto it = env.find(name);
+            return it == env.end() ? nullptr : it->second.c_str();
+        });
+    };
+    REQUIRE(detect({}) == colour::ColourDepth::FOUR_BIT);
+    REQUIRE(detect({{"TERM", "xterm"}}) == colour::ColourDepth::FOUR_BIT);
+    REQUIRE(detect({{"TERM", "xterm-256color"}}) == colour::ColourDepth::EIGHT_BIT);
+    REQUIRE(detect({{"TERM", "xterm-direct"}}) == colour::ColourDepth::TRUECOLOUR);
+    REQUIRE(detect({{"TERM", "xterm-256color"}, {"COLORTERM", "truecolor"}}) == colour::ColourDepth::TRUECOLOUR);
+    REQUIRE(detect({{"COLORTERM", "24bit"}}) == colour::ColourDepth::TRUECOLOUR);
+    REQUIRE(detect({{"TERM", "dumb"}, {"COLORTERM", "truecolor"}}) == colour::ColourDepth::NONE);
+    REQUIRE(detect({{"NO_COLOR", "1"}, {"COLORTERM", "truecolor"}}) == colour::ColourDepth::NONE);
+    // An empty NO_COLOR doesn't count
+    REQUIRE(detect({{"NO_COLOR", ""}, {"TERM", "xterm-256color"}}) == colour::ColourDepth::EIGHT_BIT);
+}
+
+TEST_CASE("Colours should be downgraded to the colour depth", "[Colour]") {
+    SECTION("Nearest colours") {
+        STATIC_REQUIRE(colour::_detail::rgbToEightBit(255, 0, 0) == 196);
+        STATIC_REQUIRE(colour::_detail::rgbToEightBit(0, 0, 0) == 16);
+        STATIC_REQUIRE(colour::_detail::rgbToEightBit(128, 128, 128) == 244);
+        STATIC_REQUIRE(colour::_detail::rgbToEightBit(95, 135, 175) == 67);
+        STATIC_REQUIRE(colour::_detail::eightBitToFourBit[196] == 91);
+        STATIC_REQUIRE(colour::_detail::eightBitToFourBit[1] == 31);
+        STATIC_REQUIRE(colour::_detail::eightBitToFourBit[232] == 30);
+        STATIC_REQUIRE(colour::_detail::eightBitToFourBit[255] == 37);
+    }
+    SECTION("Manipulators") {
+        std::stringstream ss;
+        ss << colour::force;
+        SECTION("Eight bit") {
+            ss << colour::depth<colour::ColourDepth::EIGHT_BIT>
+                << colour::fg<255, 0, 0> << colour::bg<240> << colour::fg<colour::FourBitColour::RED>;
+            REQUIRE(ss.str() == "\033[38;5;196m\033[48;5;240m\033[31m");
+        }
+        SECTION("Four bit") {
+            ss << colour::depth<colour::ColourDepth::FOUR_BIT>
+                << colour::fg<255, 0, 0> << colour::bg<196> << colour::bg<1>;
+            REQUIRE(ss.str() == "\033[91m\033[101m\033[41m");
+        }
+        SECTION("None") {
+            ss << colour::depth<colour::ColourDepth::NONE>
+                << colour::fg<255, 0, 0> << colour::use<colour::Typography::BOLD> << "owo" << colour::reset;
+            REQUIRE(ss.str() == "owo");
+        }
+        SECTION("Back to automatic") {
+            ss << colour::depth<colour::ColourDepth::FOUR_BIT> << colour::autoDepth << colour::fg<255, 0, 0>;
+            REQUIRE(ss.str() == "\033[38;2;255;0;0m");
+        }
+    }
+    SECTION("Runtime styles") {
+        auto style = colour::Style::of(colour::foreground(255, 0, 0), colour::background(240), colour::Typography::BOLD);
+        REQUIRE(style.render(colour::ColourDepth::EIGHT_BIT).view() == "\033[1;38;5;196;48;5;240m");
+        REQUIRE(style.render(colour::ColourDepth::FOUR_BIT).view() == "\033[1;91;100m");
+        REQUIRE(style.render(colour::ColourDepth::NONE).view() == "");
+
+        std::stringstream ss;
+        ss << colour::force << colour::depth<colour::ColourDepth::FOUR_BIT> << style;
+        REQUIRE(ss.str() == "\033[1;91;100m");
+
+        auto target = colour::OutputTarget::of(ss);
+        REQUIRE(target.depth == colour::ColourDepth::FOUR_BIT);
+        REQUIRE(std::format("{}", target.styled(42, colour::foreground(255, 0, 0))) == "\033[91m42\033[0m");
+    }
+}
@@ -0,0 +1,134 @@
+#include "stc/EnvSnapshot.hpp"
+#include "stc/test/TestEnvVariable.hpp"
+
+#include <catch2/catch_test_macros.hpp>
+#include <atomic>
+#include <span>
+#include <thread>
+#include <vector>
+
+TEST_CASE("EnvSnapshot should read the environment", "[EnvSnapshot]") {
+    stc::testutil::TestEnvVariable a("STC_SNAPSHOT_STRING", "trans rights");
+
+    stc::EnvSnapshot env;
+    REQUIRE(env.get("STC_SNAPSHOT_STRING") == "trans rights");
+    REQUIRE(env.get("STC_SNAPSHOT_STRING", "fallback") == "trans rights");
+
+    env.set("STC_SNAPSHOT_EMPTY", "");
+    REQUIRE(env.get("STC_SNAPSHOT_EMPTY") == "");
+    REQUIRE(env.contains("STC_SNAPSHOT_EMPTY"));
+    REQUIRE_FALSE(env.get("STC_SNAPSHOT_MISSING").has_value());
+    REQUIRE(env.get("STC_SNAPSHOT_MISSING", "fallback") == "fallback");
+}
+
+TEST_CASE("EnvSnapshot should parse typed values", "[EnvSnapshot]") {
+    stc::testutil::TestEnvVariable a("STC_SNAPSHOT_INT", "-69");
+    stc::testutil::TestEnvVariable b("STC_SNAPSHOT_NOT_INT", "69abc");
+    stc::testutil::TestEnvVariable c("STC_SNAPSHOT_BOOL", "YeS");
+    stc::testutil::TestEnvVariable d("STC_SNAPSHOT_LIST", "/a::/b");
+
+    stc::EnvSnapshot env;
+    // Twice, to hit the cache
+    for (int i = 0; i < 2; ++i) {
+        REQUIRE(env.getInt("STC_SNAPSHOT_INT") == -69);
+        REQUIRE_FALSE(env.getInt("STC_SNAPSHOT_NOT_INT").has_value());
+        REQUIRE_FALSE(env.getInt("STC_SNAPSHOT_MISSING").has_value());
+
+        REQUIRE(env.getBool("STC_SNAPSHOT_BOOL") == true);
+        REQUIRE_FALSE(env.getBool("STC_SNAPSHOT_INT").has_value());
+
+        auto list = env.getList("STC_SNAPSHOT_LIST");
+        REQUIRE(std::vector<std::string_view>(list.begin(), list.end())
+            == std::vector<std::string_view> { "/a", "", "/b" });
+        REQUIRE(env.getList("STC_SNAPSHOT_MISSING").empty());
+    }
+}
+
+TEST_CASE("EnvSnapshot updates should be copy-on-write", "[EnvSnapshot]") {
+    stc::testutil::TestEnvVariable a("STC_SNAPSHOT_A", "1");
+    stc::EnvSnapshot env;
+
+    auto old = env.get("STC_SNAPSHOT_A");
+    env.update({
+        {"STC_SNAPSHOT_A", std::nullopt},
+        {"STC_SNAPSHOT_B", "2"},
+    });
+    REQUIRE_FALSE(env.contains("STC_SNAPSHOT_A"));
+    REQUIRE(env.getInt("STC_SNAPSHOT_B") == 2);
+    // Views from before the update stay valid
+    REQUIRE(old == "1");
+    // The process environment is left alone
+    REQUIRE(std::getenv("STC_SNAPSHOT_B") == nullptr);
+
+    env.reload();
+    REQUIRE(env.get("STC_SNAPSHOT_A") == "1");
+    REQUIRE_FALSE(env.contains("STC_SNAPSHOT_B"));
+}
+
+TEST_CASE("EnvSnapshot readers should never see partial updates", "[EnvSnapshot]") {
+    stc::EnvSnapshot env;
+    env.update({{"STC_SNAPSHOT_X", "0"}, {"STC_SNAPSHOT_Y", "0"}});
+
+    std::atomic<bool> done = false;
+    std::atomic<bool> torn = false;
+    std::atomic<size_t> reads = 0;
+    std::vector<std::thread> readers;
+    for (int i = 0; i < 4; ++i) {
+        readers.emplace_back([&]() {
+            while (!done) {
+                auto view = env.view();
+                auto x = view.getInt("STC_SNAPSHOT_X");
+                auto y = view.getInt("STC_SNAPSHOT_Y");
+                if (!x.has_value() || x != y) {
+                    torn = true;
+                }
+                ++reads;
+            }
+        });
+    }
+    // Make sure the readers are actually running before the updates start
+    while (reads < readers.size()) {
+        std::this_thread::yield();
+    }
+    for (int i = 1; i < 200; ++i) {
+        auto v = std::to_string(i);
+        env.update({{"STC_SNAPSHOT_X", v}, {"STC_SNAPSHOT_Y", v}});
+    }
+    done = true;
+    for (auto& reader : readers) {
+        reader.join();
+    }
+    REQUIRE_FALSE(torn);
+    REQUIRE(env.getInt("STC_SNAPSHOT_X") == 199);
+    REQUIRE(env.getInt("STC_SNAPSHOT_Y") == 199);
+
+    // Views keep seeing the version they were created from
+    auto view = env.view();
+    env.update({{"STC_SNAPSHOT_X", "200"}, {"STC_SNAPSHOT_Y", std::nullopt}});
+    REQUIRE(view.get("STC_SNAPSHOT_X") == "199");
+    REQUIRE(view.contains("STC_SNAPSHOT_Y"));
+    REQUIRE(env.get("STC_SNAPSHOT_X") == "200");
+    REQUIRE_FALSE(env.contains("STC_SNAPSHOT_Y"));
+}
+
+TEST_CASE("EnvSnapshot lists should be shared across lookups", "[EnvSnapshot]") {
+    stc::EnvSnapshot env;
+    env.set("STC_SNAPSHOT_LIST", "a:b:c");
+
+    std::vector<std::thread> readers;
+    std::vector<std::span<const std::string_view>> results(8);
+    for (size_t i = 0; i < results.size(); ++i) {
+        readers.emplace_back([&, i]() {
+            results.at(i) = env.getList("STC_SNAPSHOT_LIST");
+        });
+    }
+    for (auto& reader : readers) {
+        reader.join();
+    }
+    for (const auto& result : results) {
+        REQUIRE(std::vector<std::string_view>(result.begin(), result.end())
+            == std::vector<std::string_view> { "a", "b", "c" });
+    }
+    // Once cached, every lookup returns the same storage
+    REQUIRE(env.getList("STC_SNAPSHOT_LIST").data() == env.getList("STC_SNAPSHOT_LIST").data());
+}
@@ -135,3 +135,36 @@ TEST_CASE("Vectorised syscommand should handle errors", "[Environment][syscomman
     REQUIRE(code != 0);
 }
 #endif
+
+#ifndef _WIN32
+TEST_CASE("expandUserPath should expand home directories", "[Environment][expandUserPath]") {
+    auto home = stc::getHome();
+    REQUIRE(!home.empty());
+
+    REQUIRE(stc::expandUserPath("/some/path") == "/some/path");
+    REQUIRE(stc::expandUserPath("some\\path") == "some/path");
+    REQUIRE(stc::expandUserPath("") == "");
+    REQUIRE(stc::expandUserPath("~") == home / "");
+    REQUIRE(stc::expandUserPath("~/a/b") == home / "a/b");
+    REQUIRE(stc::expandUserPath("~\\a\\b") == home / "a/b");
+
+    // root is the only user that can reasonably be assumed to exist
+    auto rootHome = stc::expandUserPath("~root");
+    REQUIRE(rootHome == stc::expandUserPath("~root/"));
+    REQUIRE(stc::expandUserPath("~root/a") == rootHome / "a");
+
+    REQUIRE_THROWS(stc::expandUserPath("~stc-user-that-does-not-exist/a"));
+}
+
+TEST_CASE("expandUserPaths should match expandUserPath", "[Environment][expandUserPath]") {
+    std::vector<std::string> paths {
+        "~", "~/a", "~root", "~root/b\\c", "/d", "e", "~/f",
+    };
+    auto expanded = stc::expandUserPaths(paths);
+    REQUIRE(expanded.size() == paths.size());
+    for (size_t i = 0; i < paths.size(); ++i) {
+        INFO(paths.at(i));
+        REQUIRE(expanded.at(i) == stc::expandUserPath(paths.at(i)));
+    }
+}
+#endif
@@ -1,9 +1,66 @@
 #include "stc/minilog.hpp"
 #include "stc/test/CaptureStream.hpp"
+#include "stc/test/TestDirectory.hpp"
 #include <catch2/catch_test_macros.hpp>
 
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cmath>
+#include <cstdio>
+#include <ctime>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <ranges>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifndef _WIN32
+#include <unistd.h>
+#endif
+
+namespace {
+
+/**
+ * minilog writes straight to an fd, so CaptureStream can't see it. This points minilog at a temporary file instead.
+ */
+struct CaptureLog {
+    FILE* file;
+
+    CaptureLog(bool colour = false) : file(std::tmpfile()) {
+        REQUIRE(file != nullptr);
+#ifdef _WIN32
+        minilog::setOutput(_fileno(file), colour);
+#else
+        minilog::setOutput(fileno(file), colour);
+#endif
+    }
+
+    ~CaptureLog() {
+        minilog::setOutput(1);
+        std::fclose(file);
+    }
+
+    std::string content() {
+        std::string out;
+        char buff[4096];
+        std::fseek(file, 0, SEEK_SET);
+        size_t count;
+        while ((count = std::fread(buff, 1, sizeof(buff), file)) > 0) {
+            out.append(buff, count);
+        }
+        return out;
+    }
+};
+
+}
+
 TEST_CASE("All functions compile") {
     stc::testutil::CaptureStandardStreams capt;
+    CaptureLog log;
     minilog::debug("Test {}", "function");
     minilog::info("Test {}", "function");
     minilog::warn("Test {}", "function");
@@ -11,9 +68,10 @@ TEST_CASE("All functions compile") {
     minilog::critical("Test {}", "function");
 
     auto cerr = capt.cerr.content.str();
-    auto cout = capt.cout.content.str();
+    auto cout = log.content();
 
     REQUIRE(cerr == "");
+    REQUIRE(capt.cout.content.str() == "");
     REQUIRE(cout.find("| debug    | Test function") != std::string::npos);
     REQUIRE(cout.find("| info     | Test function") != std::string::npos);
     REQUIRE(cout.find("| warning  | Test function") != std::string::npos);
@@ -21,3 +79,705 @@ TEST_CASE("All functions compile") {
     REQUIRE(cout.find("| critical | Test function") != std::string::npos);
 
 }
+
+TEST_CASE("Levels should filter records", "[Minilog]") {
+    CaptureLog log;
+    STATIC_REQUIRE(minilog::minLevel == 0);
+
+    minilog::setLevel(minilog::Level::Warning);
+    REQUIRE(minilog::getLevel() == minilog::Level::Warning);
+    REQUIRE_FALSE(minilog::isEnabled<minilog::Level::Info>());
+    REQUIRE(minilog::isEnabled<minilog::Level::Warning>());
+
+    int evaluated = 0;
+    auto expensive = [&]() { return ++evaluated; };
+    minilog::log<minilog::Level::Info>("skipped {}", 1);
+    MINILOG_LOG(minilog::Level::Info, "skipped {}", expensive());
+    MINILOG_LOG(minilog::Level::Error, "logged {}", expensive());
+    minilog::setLevel(minilog::Level::Debug);
+
+    auto cout = log.content();
+    REQUIRE(evaluated == 1);
+    REQUIRE(cout.find("skipped") == std::string::npos);
+    REQUIRE(cout.find("| error    | logged 1") != std::string::npos);
+}
+
+TEST_CASE("Records should be written in one piece", "[Minilog]") {
+    SECTION("Without colour") {
+        CaptureLog log;
+        minilog::log<minilog::Level::Warning>("{} {}", "owo", 42);
+        auto content = log.content();
+        REQUIRE(content.size() == 12 + std::string_view(" | warning  | owo 42\n").size());
+        REQUIRE(content.substr(12) == " | warning  | owo 42\n");
+    }
+    SECTION("With colour") {
+        CaptureLog log(true);
+        minilog::log<minilog::Level::Error>("uwu");
+        auto content = log.content();
+        REQUIRE(content.starts_with("\033[91m"));
+        REQUIRE(content.ends_with(" | error    | uwu\n\033[0m"));
+    }
+}
+
+TEST_CASE("Cached timestamps should match std::format", "[Minilog]") {
+    using namespace std::chrono;
+    minilog::_detail::TimestampCache cache;
+    auto start = system_clock::now();
+    // Steps of 7ms and 1.3s, to cover both cache hits and misses across seconds, minutes, and hours
+    for (int i = 0; i < 2000; ++i) {
+        auto time = start + milliseconds(7 * i) + seconds(i * 13 / 10);
+        auto expected = std::format("{:%T}", floor<milliseconds>(time));
+        INFO(expected);
+        REQUIRE(cache.render(time) == expected);
+    }
+    REQUIRE(cache.render(sys_days(2024y / 1 / 1) + 23h + 59min + 59s + 999ms) == "23:59:59.999");
+    REQUIRE(cache.render(sys_days(2024y / 1 / 2) + 5ms) == "00:00:00.005");
+}
+
+#ifndef _WIN32
+namespace {
+
+std::string readFd(int fd) {
+    std::string out;
+    char buff[4096];
+    lseek(fd, 0, SEEK_SET);
+    ssize_t count;
+    while ((count = read(fd, buff, sizeof(buff))) > 0) {
+        out.append(buff, static_cast<size_t>(count));
+    }
+    return out;
+}
+
+}
+
+TEST_CASE("Async mode should write every record", "[Minilog]") {
+    FILE* file = std::tmpfile();
+    REQUIRE(file != nullptr);
+    int fd = fileno(file);
+
+    minilog::startAsync({ .capacity = 64, .fd = fd, .colour = false });
+    REQUIRE_THROWS(minilog::startAsync());
+
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 4; ++t) {
+        threads.emplace_back([t]() {
+            for (int i = 0; i < 1000; ++i) {
+                minilog::log<minilog::Level::Info>("thread {} record {}", t, i);
+            }
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    minilog::flush();
+    auto flushed = readFd(fd);
+    minilog::stopAsync();
+
+    std::array<int, 4> next {};
+    size_t lines = 0;
+    for (auto line : std::views::split(std::string_view(flushed), '\n')) {
+        std::string_view view(line.begin(), line.end());
+        if (view.empty()) {
+            continue;
+        }
+        ++lines;
+        REQUIRE(view.find("| info     | thread ") != std::string_view::npos);
+        auto record = view.substr(view.find("thread ") + 7);
+        int t = record[0] - '0';
+        // Records from a single thread must stay in order
+        REQUIRE(record.substr(2) == "record " + std::to_string(next.at(t)));
+        ++next[t];
+    }
+    REQUIRE(lines == 4000);
+    REQUIRE(minilog::getDroppedCount() == 0);
+    std::fclose(file);
+}
+
+TEST_CASE("Async flushes should cover the caller's own records", "[Minilog]") {
+    FILE* file = std::tmpfile();
+    REQUIRE(file != nullptr);
+    int fd = fileno(file);
+
+    minilog::startAsync({ .capacity = 64, .fd = fd, .colour = false });
+    std::atomic<size_t> missing = 0;
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 4; ++t) {
+        threads.emplace_back([&, t]() {
+            for (int i = 0; i < 200; ++i) {
+                minilog::log<minilog::Level::Info>("flush {} {}", t, i);
+                minilog::flush();
+
+                // pread, as the writer thread shares the file offset
+                std::string content;
+                char buff[4096];
+                ssize_t count;
+                while ((count = pread(fd, buff, sizeof(buff), static_cast<off_t>(content.size()))) > 0) {
+                    content.append(buff, static_cast<size_t>(count));
+                }
+                if (content.find(std::format("flush {} {}\n", t, i)) == std::string::npos) {
+                    ++missing;
+                }
+            }
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    minilog::stopAsync();
+    REQUIRE(missing == 0);
+    std::fclose(file);
+}
+
+TEST_CASE("Async mode should drop and count records that don't fit", "[Minilog]") {
+    int fds[2];
+    REQUIRE(pipe(fds) == 0);
+
+    // Nobody reads the pipe yet, so the writer ends up blocked on a full pipe, and the queue fills up
+    minilog::startAsync({ .capacity = 4, .overflow = minilog::OverflowPolicy::COUNT, .fd = fds[1], .colour = false });
+    std::string large(8192, 'x');
+    for (int i = 0; i < 64; ++i) {
+        minilog::log<minilog::Level::Info>("{}", large);
+    }
+    auto dropped = minilog::getDroppedCount();
+    REQUIRE(dropped > 0);
+
+    std::string output;
+    std::thread reader([&]() {
+        char buff[4096];
+        ssize_t count;
+        while ((count = read(fds[0], buff, sizeof(buff))) > 0) {
+            output.append(buff, static_cast<size_t>(count));
+        }
+    });
+    minilog::stopAsync();
+    close(fds[1]);
+    reader.join();
+    close(fds[0]);
+
+    size_t records = 0;
+    for (size_t pos = 0; (pos = output.find(large, pos)) != std::string::npos; pos += large.size()) {
+        ++records;
+    }
+    REQUIRE(records + dropped == 64);
+    REQUIRE(output.find("minilog: dropped ") != std::string::npos);
+}
+#endif
+
+namespace {
+
+struct NotBinarySafe {
+    int value;
+};
+
+}
+
+template <>
+struct std::formatter<NotBinarySafe> : std::formatter<int> {
+    template <typename FormatContext>
+    auto format(const NotBinarySafe& v, FormatContext& ctx) const {
+        return std::formatter<int>::format(v.value, ctx);
+    }
+};
+
+TEST_CASE("Binary mode should format records on the consumer thread", "[Minilog]") {
+    CaptureLog log;
+    FILE* file = std::tmpfile();
+    REQUIRE(file != nullptr);
+
+    STATIC_REQUIRE(minilog::_detail::BinaryEncodable<const char(&)[4]>);
+    STATIC_REQUIRE(minilog::_detail::BinaryEncodable<std::string&>);
+    STATIC_REQUIRE(minilog::_detail::BinaryEncodable<double>);
+    STATIC_REQUIRE_FALSE(minilog::_detail::BinaryEncodable<NotBinarySafe>);
+    STATIC_REQUIRE_FALSE(minilog::_detail::BinaryEncodable<int*>);
+
+    minilog::startBinary({ .fd = fileno(file), .colour = false });
+    REQUIRE_THROWS(minilog::startAsync());
+    REQUIRE_THROWS(minilog::startBinary());
+
+    minilog::log<minilog::Level::Info>("ints {} {}", 42, -7LL);
+    minilog::log<minilog::Level::Warning>("floats {} {}", 1.5, true);
+    {
+        std::string temporary = "this string is gone by the time it's formatted";
+        minilog::log<minilog::Level::Error>("strings {} {}", "owo", temporary);
+    }
+    minilog::log<minilog::Level::Info>("fallback {}", NotBinarySafe { 69 });
+    minilog::log<minilog::Level::Debug>("no args");
+    minilog::flush();
+    minilog::stopBinary();
+
+    std::string content;
+    char buff[4096];
+    std::fseek(file, 0, SEEK_SET);
+    size_t count;
+    while ((count = std::fread(buff, 1, sizeof(buff), file)) > 0) {
+        content.append(buff, count);
+    }
+    std::fclose(file);
+
+    std::vector<std::string> lines;
+    for (auto line : std::views::split(std::string_view(content), '\n')) {
+        if (!line.empty()) {
+            lines.emplace_back(std::string_view(line.begin(), line.end()).substr(12));
+        }
+    }
+    REQUIRE(lines == std::vector<std::string> {
+        " | info     | ints 42 -7",
+        " | warning  | floats 1.5 true",
+        " | error    | strings owo this string is gone by the time it's formatted",
+        " | info     | fallback 69",
+        " | debug    | no args",
+    });
+    // Nothing should have gone through the synchronous path
+    REQUIRE(log.content() == "");
+}
+
+#ifndef _WIN32
+TEST_CASE("Binary mode should keep per-thread order and count drops", "[Minilog]") {
+    FILE* file = std::tmpfile();
+    REQUIRE(file != nullptr);
+
+    SECTION("Ordering") {
+        minilog::startBinary({ .fd = fileno(file), .colour = false });
+        std::vector<std::thread> threads;
+        for (int t = 0; t < 4; ++t) {
+            threads.emplace_back([t]() {
+                for (int i = 0; i < 1000; ++i) {
+                    minilog::log<minilog::Level::Info>("thread {} record {}", t, i);
+                }
+            });
+        }
+        for (auto& thread : threads) {
+            thread.join();
+        }
+        minilog::stopBinary();
+
+        auto content = readFd(fileno(file));
+        std::array<int, 4> next {};
+        for (auto line : std::views::split(std::string_view(content), '\n')) {
+            std::string_view view(line.begin(), line.end());
+            if (view.empty()) {
+                continue;
+            }
+            auto record = view.substr(view.find("thread ") + 7);
+            int t = record[0] - '0';
+            REQUIRE(record.substr(2) == "record " + std::to_string(next.at(t)));
+            ++next[t];
+        }
+        REQUIRE(next == std::array<int, 4> { 1000, 1000, 1000, 1000 });
+    }
+    SECTION("Drops") {
+        // The consumer won't get to the ring before it's full
+        minilog::startBinary({
+            .bufferSize = 4096,
+            .pollInterval = std::chrono::hours(1),
+            .fd = fileno(file),
+            .colour = false,
+        });
+        // Let the first pass finish, so the consumer is asleep
+        minilog::flush();
+        for (int i = 0; i < 1000; ++i) {
+            minilog::log<minilog::Level::Info>("record {}", i);
+        }
+        auto dropped = minilog::getDroppedCount();
+        minilog::stopBinary();
+        REQUIRE(dropped > 0);
+
+        auto content = readFd(fileno(file));
+        size_t records = 0;
+        for (size_t pos = 0; (pos = content.find("| record ", pos)) != std::string::npos; ++pos) {
+            ++records;
+        }
+        REQUIRE(records + dropped == 1000);
+        REQUIRE(content.find("minilog: dropped " + std::to_string(dropped) + " records") != std::string::npos);
+    }
+    SECTION("Flushing while another thread keeps logging") {
+        minilog::startBinary({ .fd = fileno(file), .colour = false });
+        std::atomic<bool> done = false;
+        std::atomic<bool> started = false;
+        std::thread logger([&]() {
+            while (!done.load(std::memory_order_relaxed)) {
+                minilog::log<minilog::Level::Info>("busy");
+                started.store(true, std::memory_order_relaxed);
+            }
+        });
+        while (!started.load(std::memory_order_relaxed)) {
+            std::this_thread::yield();
+        }
+        // The consumer always has something to write here, so a flush can't wait for it to run out
+        for (int i = 0; i < 10; ++i) {
+            minilog::flush();
+        }
+        done = true;
+        logger.join();
+        minilog::stopBinary();
+        REQUIRE(readFd(fileno(file)).find("busy") != std::string::npos);
+    }
+    SECTION("Drops from threads that have exited") {
+        minilog::startBinary({
+            .bufferSize = 4096,
+            .pollInterval = std::chrono::hours(1),
+            .fd = fileno(file),
+            .colour = false,
+        });
+        minilog::flush();
+        std::thread([]() {
+            for (int i = 0; i < 1000; ++i) {
+                minilog::log<minilog::Level::Info>("record {}", i);
+            }
+        }).join();
+        auto dropped = minilog::getDroppedCount();
+        REQUIRE(dropped > 0);
+        // The first pass removes the thread's ring, and the ones after it shouldn't see a change in the count
+        minilog::flush();
+        REQUIRE(minilog::getDroppedCount() == dropped);
+        minilog::log<minilog::Level::Info>("after");
+        minilog::flush();
+        minilog::stopBinary();
+
+        auto content = readFd(fileno(file));
+        auto message = "minilog: dropped " + std::to_string(dropped) + " records\n";
+        REQUIRE(content.find(message) != std::string::npos);
+        REQUIRE(content.find("minilog: dropped ") == content.find(message));
+        REQUIRE(content.find("minilog: dropped ", content.find(message) + 1) == std::string::npos);
+    }
+    std::fclose(file);
+}
+#endif
+
+#ifndef _WIN32
+namespace {
+
+/**
+ * \returns the content of every segment in the folder, in order, and checks that none of them are larger than the
+ *          segment size.
+ */
+std::string readSegments(const std::filesystem::path& folder, size_t segmentSize, size_t& count) {
+    std::vector<std::filesystem::path> paths;
+    for (const auto& entry : std::filesystem::directory_iterator(folder)) {
+        paths.push_back(entry.path());
+    }
+    std::sort(paths.begin(), paths.end());
+    count = paths.size();
+
+    std::string out;
+    for (const auto& path : paths) {
+        std::ifstream stream(path, std::ios::binary);
+        std::stringstream ss;
+        ss << stream.rdbuf();
+        auto content = ss.str();
+        INFO(path.string());
+        REQUIRE(content.size() <= segmentSize);
+        out += content;
+    }
+    return out;
+}
+
+void testFileSink(const std::filesystem::path& folder, bool useMmap) {
+    CaptureLog log;
+    auto path = (folder / "test.log").string();
+
+    SECTION("Size rotation") {
+        minilog::startFileSink({ .path = path, .segmentSize = 4096, .useMmap = useMmap });
+        REQUIRE_THROWS(minilog::startFileSink({ .path = path }));
+
+        std::vector<std::thread> threads;
+        for (int t = 0; t < 4; ++t) {
+            threads.emplace_back([t]() {
+                for (int i = 0; i < 500; ++i) {
+                    minilog::log<minilog::Level::Info>("thread {} record {}", t, i);
+                }
+            });
+        }
+        for (auto& thread : threads) {
+            thread.join();
+        }
+        minilog::stopFileSink();
+
+        size_t segments;
+        auto content = readSegments(folder, 4096, segments);
+        REQUIRE(segments > 1);
+        // The unused preallocated space has to be trimmed off
+        REQUIRE(content.find('\0') == std::string::npos);
+
+        std::array<int, 4> next {};
+        for (auto line : std::views::split(std::string_view(content), '\n')) {
+            std::string_view view(line.begin(), line.end());
+            if (view.empty()) {
+                continue;
+            }
+            auto record = view.substr(view.find("thread ") + 7);
+            int t = record[0] - '0';
+            REQUIRE(record.substr(2) == "record " + std::to_string(next.at(t)));
+            ++next[t];
+        }
+        REQUIRE(next == std::array<int, 4> { 500, 500, 500, 500 });
+    }
+    SECTION("Oversized records") {
+        minilog::startFileSink({ .path = path, .segmentSize = 4096, .useMmap = useMmap });
+        std::string large(10000, 'x');
+        minilog::log<minilog::Level::Info>("before");
+        minilog::log<minilog::Level::Info>("{}", large);
+        minilog::log<minilog::Level::Info>("after");
+        minilog::stopFileSink();
+
+        size_t segments;
+        auto content = readSegments(folder, 10000 + 64, segments);
+        REQUIRE(segments == 3);
+        auto before = content.find("before");
+        auto middle = content.find(large);
+        auto after = content.find("after");
+        REQUIRE(before < middle);
+        REQUIRE(middle != std::string::npos);
+        REQUIRE(middle < after);
+        REQUIRE(after != std::string::npos);
+    }
+    SECTION("Time rotation") {
+        minilog::startFileSink({ .path = path, .rotateInterval = std::chrono::seconds(1), .useMmap = useMmap });
+        minilog::log<minilog::Level::Info>("first");
+        std::this_thread::sleep_for(std::chrono::milliseconds(1500));
+        minilog::log<minilog::Level::Info>("second");
+        minilog::stopFileSink();
+
+        size_t segments;
+        auto content = readSegments(folder, 64 << 20, segments);
+        REQUIRE(segments == 2);
+        REQUIRE(content.find("first") < content.find("second"));
+    }
+    // Nothing should have gone to the fd
+    REQUIRE(log.content() == "");
+}
+
+}
+
+TEST_CASE("The file sink should rotate without losing records", "[Minilog]") {
+    stc::testutil::TestDirectory dir(std::filesystem::current_path() / "_stc_tests_minilog_file_sink", true);
+    REQUIRE_THROWS(minilog::startFileSink({}));
+
+    SECTION("With pwrite") {
+        testFileSink(dir.folder, false);
+    }
+    SECTION("With mmap") {
+        testFileSink(dir.folder, true);
+    }
+}
+
+TEST_CASE("The file sink should back off when it can't rotate", "[Minilog]") {
+    stc::testutil::TestDirectory dir(std::filesystem::current_path() / "_stc_tests_minilog_file_sink_backoff", true);
+    auto folder = dir.folder / "logs";
+    std::filesystem::create_directories(folder);
+    CaptureLog log;
+
+    minilog::startFileSink({ .path = (folder / "test.log").string(), .rotateInterval = std::chrono::seconds(1) });
+    minilog::log<minilog::Level::Info>("first");
+    // The open segment survives this, but no new segments can be created
+    std::filesystem::remove_all(folder);
+
+    auto cpuStart = std::clock();
+    std::this_thread::sleep_for(std::chrono::milliseconds(1500));
+    auto cpuTime = static_cast<double>(std::clock() - cpuStart) / CLOCKS_PER_SEC;
+    // Retrying the rotation in a loop would keep the sink thread busy for most of the wait
+    REQUIRE(cpuTime < 0.25);
+
+    minilog::log<minilog::Level::Info>("second");
+    minilog::stopFileSink();
+    REQUIRE(log.content() == "");
+}
+#endif
+
+TEST_CASE("Rate limits should allow bursts and count what they suppress", "[Minilog]") {
+    using namespace std::chrono_literals;
+    minilog::RateLimit limit(100, 1s);
+    auto start = std::chrono::nanoseconds(1000s);
+
+    // Each phase runs in a single interval, from several threads at once
+    auto run = [&](std::chrono::nanoseconds now, uint32_t& suppressed) {
+        std::atomic<int> allowed = 0;
+        std::atomic<uint32_t> reported = 0;
+        std::vector<std::thread> threads;
+        for (int t = 0; t < 8; ++t) {
+            threads.emplace_back([&]() {
+                for (int i = 0; i < 10000; ++i) {
+                    auto result = limit.check(now);
+                    if (result.allowed) {
+                        ++allowed;
+                    }
+                    // Catch's assertions aren't thread-safe, so this is checked through the totals instead
+                    if (result.allowed) {
+                        reported += result.suppressed;
+                    }
+                }
+            });
+        }
+        for (auto& thread : threads) {
+            thread.join();
+        }
+        suppressed = reported;
+        return allowed.load();
+    };
+
+    uint32_t suppressed;
+    REQUIRE(run(start, suppressed) == 100);
+    REQUIRE(suppressed == 0);
+    REQUIRE(run(start + 1500ms, suppressed) == 100);
+    REQUIRE(suppressed == 80000 - 100);
+    // Late clock reads count towards the current interval
+    REQUIRE_FALSE(limit.check(start).allowed);
+
+    auto result = limit.check(start + 5s);
+    REQUIRE(result.allowed);
+    REQUIRE(result.suppressed == 80000 - 100 + 1);
+}
+
+TEST_CASE("Rate limits should work in any interval", "[Minilog]") {
+    using namespace std::chrono_literals;
+    auto allowedAt = [](minilog::RateLimit& limit, std::chrono::nanoseconds now) {
+        int allowed = 0;
+        for (int i = 0; i < 20; ++i) {
+            allowed += limit.check(now).allowed;
+        }
+        return allowed;
+    };
+
+    SECTION("The first interval") {
+        minilog::RateLimit limit(5, 60s);
+        REQUIRE(allowedAt(limit, 10s) == 5);
+        REQUIRE(allowedAt(limit, 59s) == 0);
+        auto result = limit.check(60s);
+        REQUIRE(result.allowed);
+        REQUIRE(result.suppressed == 15 + 20);
+    }
+    SECTION("Around the interval number wrapping") {
+        minilog::RateLimit limit(5, 1s);
+        auto wrap = std::chrono::nanoseconds(std::chrono::seconds(int64_t(1) << 31));
+        REQUIRE(allowedAt(limit, wrap - 1s) == 5);
+        REQUIRE(allowedAt(limit, wrap) == 5);
+        REQUIRE(allowedAt(limit, wrap + 1s) == 5);
+        REQUIRE(allowedAt(limit, wrap + 1s) == 0);
+
+        // Truncates to interval 0 in both 31 and 32 bits
+        minilog::RateLimit fresh(5, 1s);
+        REQUIRE(allowedAt(fresh, 2 * wrap) == 5);
+        REQUIRE(allowedAt(fresh, 2 * wrap) == 0);
+    }
+}
+
+TEST_CASE("Rate limited callsites should report suppressed records", "[Minilog]") {
+    CaptureLog log;
+    int evaluated = 0;
+    auto expensive = [&]() { return ++evaluated; };
+
+    // The last round is a single record, which reports what was suppressed in the round before it
+    for (int round = 0; round < 3; ++round) {
+        for (int i = 0; i < (round == 2 ? 1 : 1000); ++i) {
+            MINILOG_LOG_LIMITED(minilog::Level::Error, 5, std::chrono::milliseconds(100), "record {}", expensive());
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(150));
+    }
+    MINILOG_LOG_LIMITED(minilog::Level::Error, 5, std::chrono::milliseconds(100), "other callsite");
+
+    auto content = log.content();
+    int records = 0;
+    int suppressed = 0;
+    for (auto line : std::views::split(std::string_view(content), '\n')) {
+        std::string_view view(line.begin(), line.end());
+        if (view.find("| record ") != std::string_view::npos) {
+            ++records;
+        } else if (auto pos = view.find("| suppressed "); pos != std::string_view::npos) {
+            REQUIRE(view.ends_with(" similar messages"));
+            suppressed += std::stoi(std::string(view.substr(pos + 13)));
+        }
+    }
+    // The loops may straddle an interval, but every record is either logged or reported
+    REQUIRE(records == evaluated);
+    REQUIRE(records >= 11);
+    REQUIRE(records + suppressed == 2001);
+    REQUIRE(content.find("| other callsite") != std::string::npos);
+}
+
+namespace {
+
+struct ScopedFormat {
+    ScopedFormat(minilog::RecordFormat format) {
+        minilog::setFormat(format);
+    }
+    ~ScopedFormat() {
+        minilog::setFormat(minilog::RecordFormat::TEXT);
+    }
+};
+
+}
+
+TEST_CASE("Structured records should be encoded for machine-readable formats", "[Minilog]") {
+    STATIC_REQUIRE(std::output_iterator<minilog::_detail::EscapingAppender, const char&>);
+    // Colour is requested, but must never show up outside TEXT
+    CaptureLog log(true);
+    std::string path = "/a \"b\"";
+
+    SECTION("JSON") {
+        ScopedFormat format(minilog::RecordFormat::JSON);
+        minilog::logKV<minilog::Level::Info>(
+            "request\ndone",
+            minilog::kv("ms", 12),
+            minilog::kv("path", path),
+            minilog::kv("ok", true),
+            minilog::kv("ratio", 0.5),
+            minilog::kv("nan", std::nan("")),
+            minilog::kv("custom", NotBinarySafe { 7 })
+        );
+        minilog::log<minilog::Level::Error>("plain {}", "\"record\"");
+
+        auto content = log.content();
+        REQUIRE(content.find('\033') == std::string::npos);
+        REQUIRE(content.starts_with("{\"time\":\""));
+        auto second = content.find('\n') + 1;
+        REQUIRE(content.substr(9 + 24, second - 9 - 24) == "\",\"level\":\"info\",\"msg\":\"request\\ndone\",\"ms\":12,"
+            "\"path\":\"/a \\\"b\\\"\",\"ok\":true,\"ratio\":0.5,\"nan\":null,\"custom\":\"7\"}\n");
+        REQUIRE(content.substr(second + 9 + 24) == "\",\"level\":\"error\",\"msg\":\"plain \\\"record\\\"\"}\n");
+    }
+    SECTION("logfmt") {
+        ScopedFormat format(minilog::RecordFormat::LOGFMT);
+        minilog::logKV<minilog::Level::Warning>(
+            "request done",
+            minilog::kv("ms", 12),
+            minilog::kv("path", path),
+            minilog::kv("empty", ""),
+            minilog::kv("custom", NotBinarySafe { 7 })
+        );
+
+        auto content = log.content();
+        REQUIRE(content.starts_with("time="));
+        REQUIRE(content.substr(5 + 24) == " level=warning msg=\"request done\" ms=12 path=\"/a \\\"b\\\"\" empty=\"\" "
+            "custom=7\n");
+    }
+    SECTION("Text") {
+        minilog::logKV<minilog::Level::Info>("request done", minilog::kv("ms", 12), minilog::kv("path", "/x"));
+        auto content = log.content();
+        REQUIRE(content.starts_with("\033[34m"));
+        REQUIRE(content.ends_with(" | info     | request done ms=12 path=/x\n\033[0m"));
+    }
+#ifndef _WIN32
+    SECTION("Binary mode") {
+        ScopedFormat format(minilog::RecordFormat::JSON);
+        FILE* file = std::tmpfile();
+        REQUIRE(file != nullptr);
+        minilog::startBinary({ .fd = fileno(file), .colour = true });
+        minilog::log<minilog::Level::Info>("deferred {}", 42);
+        minilog::logKV<minilog::Level::Info>("structured", minilog::kv("n", 1));
+        minilog::stopBinary();
+
+        auto content = readFd(fileno(file));
+        std::fclose(file);
+        REQUIRE(content.find("\"msg\":\"deferred 42\"}\n") != std::string::npos);
+        REQUIRE(content.find("\"msg\":\"structured\",\"n\":1}\n") != std::string::npos);
+        REQUIRE(content.find('\033') == std::string::npos);
+    }
+#endif
+}
+
+TEST_CASE("Cached RFC 3339 timestamps should include the date", "[Minilog]") {
+    using namespace std::chrono;
+    minilog::_detail::DateTimeCache cache;
+    REQUIRE(cache.render(sys_days(2024y / 1 / 2) + 5ms) == "2024-01-02T00:00:00.005Z");
+    REQUIRE(cache.render(sys_days(1999y / 12 / 31) + 23h + 59min + 59s + 999ms) == "1999-12-31T23:59:59.999Z");
+    REQUIRE(cache.render(sys_days(2024y / 2 / 29) + 12h + 34min + 56s + 780ms) == "2024-02-29T12:34:56.780Z");
+}
@@ -159,3 +159,48 @@ TEST_CASE("Verify ascii string equality") {
     );
 }
 
+
+TEST_CASE("splitShellWords should follow POSIX quoting", "[Feat][String]") {
+    bool requiresShell = true;
+    auto res = stc::string::splitShellWords(
+        R"(  printf 'a b'  "c \"d\" \x" e\ f "" g\
+h	i)",
+        &requiresShell
+    );
+    REQUIRE_FALSE(requiresShell);
+    REQUIRE(res == std::vector<std::string> {
+        "printf", "a b", R"(c "d" \x)", "e f", "", "gh", "i"
+    });
+
+    REQUIRE(stc::string::splitShellWords("").empty());
+    REQUIRE(stc::string::splitShellWords(" \t ").empty());
+    REQUIRE(stc::string::splitShellWords("a#b ~c").at(0) == "a#b");
+    REQUIRE_THROWS(stc::string::splitShellWords("'unterminated"));
+    REQUIRE_THROWS(stc::string::splitShellWords("\"unterminated"));
+    REQUIRE_THROWS(stc::string::splitShellWords("trailing\\"));
+}
+
+TEST_CASE("splitShellWords should detect shell features", "[Feat][String]") {
+    auto check = [](const std::string& input) {
+        bool requiresShell = false;
+        stc::string::splitShellWords(input, &requiresShell);
+        return requiresShell;
+    };
+
+    REQUIRE(check("a | b"));
+    REQUIRE(check("a && b"));
+    REQUIRE(check("a; b"));
+    REQUIRE(check("a > b"));
+    REQUIRE(check("a\nb"));
+    REQUIRE(check("ls *.cpp"));
+    REQUIRE(check("echo $HOME"));
+    REQUIRE(check("echo \"$HOME\""));
+    REQUIRE(check("echo `id`"));
+    REQUIRE(check("ls ~"));
+    REQUIRE(check("a # comment"));
+    REQUIRE(check("FOO=bar cmd"));
+
+    REQUIRE_FALSE(check("echo '$HOME | *'"));
+    REQUIRE_FALSE(check("echo \\$HOME \\*"));
+    REQUIRE_FALSE(check("cmd --flag=value a~b"));
+}
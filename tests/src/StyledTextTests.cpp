@@ -0,0 +1,108 @@
+#include <catch2/catch_test_macros.hpp>
+
+#include <sstream>
+#include <stc/StyledText.hpp>
+
+#ifndef _WIN32
+#include <unistd.h>
+#endif
+
+using namespace stc::colour;
+
+TEST_CASE("StyledText should merge identical spans", "[StyledText]") {
+    StyledText text;
+    text.append("a", foreground(FourBitColour::RED))
+        .append("b", foreground(FourBitColour::RED))
+        .append("")
+        .append("c");
+
+    REQUIRE(text.getSpans().size() == 2);
+    REQUIRE(text.plain() == "abc");
+    REQUIRE(text.render() == "\033[31mab\033[0mc");
+    REQUIRE(text.render(false) == "abc");
+}
+
+TEST_CASE("StyledText should only emit changed parameters", "[StyledText]") {
+    StyledText text;
+    SECTION("Colour changes") {
+        text.append("a", foreground(FourBitColour::RED), background(240), Typography::BOLD)
+            .append("b", foreground(FourBitColour::BLUE), background(240), Typography::BOLD)
+            .append("c", background(240), Typography::BOLD);
+        REQUIRE(text.render() == "\033[1;31;48;5;240ma\033[34mb\033[39mc\033[0m");
+    }
+    SECTION("Typography changes") {
+        text.append("a", Typography::BOLD, Typography::FAINT, Typography::ITALIC)
+            .append("b", Typography::FAINT, Typography::ITALIC)
+            .append("c", Typography::FAINT, Typography::UNDERLINE);
+        // Removing bold also removes faint, so faint has to be turned back on
+        REQUIRE(text.render() == "\033[1;2;3ma\033[22;2mb\033[23;4mc\033[0m");
+    }
+    SECTION("Resets when shorter") {
+        text.append("a", foreground(1, 2, 3), background(4, 5, 6), Typography::BOLD, Typography::ITALIC)
+            .append("b", Typography::UNDERLINE);
+        // 22;23;4;39;49 is longer than 0;4
+        REQUIRE(text.render() == "\033[1;3;38;2;1;2;3;48;2;4;5;6ma\033[0;4mb\033[0m");
+    }
+    SECTION("Off-codes are ignored in spans") {
+        text.append("a", Typography::NO_ITALIC).append("b");
+        REQUIRE(text.getSpans().size() == 1);
+        REQUIRE(text.render() == "ab");
+    }
+}
+
+TEST_CASE("StyledText should respect stream colour settings", "[StyledText]") {
+    StyledText text;
+    text.append("a", Typography::BOLD);
+
+    std::stringstream ss;
+    text.writeTo(ss);
+    REQUIRE(ss.str() == "a");
+
+    ss.str("");
+    ss << force;
+    text.writeTo(ss);
+    REQUIRE(ss.str() == "\033[1ma\033[0m");
+}
+
+TEST_CASE("StyledText should downgrade colours to the stream's depth", "[StyledText]") {
+    StyledText text;
+    // Both of these are closest to bright red with 4 bit colour
+    text.append("a", foreground(255, 0, 0)).append("b", foreground(196));
+
+    REQUIRE(text.render(ColourDepth::EIGHT_BIT) == "\033[38;5;196mab\033[0m");
+    REQUIRE(text.render(ColourDepth::NONE) == "ab");
+
+    std::stringstream ss;
+    ss << force << depth<ColourDepth::FOUR_BIT>;
+    text.writeTo(ss);
+    REQUIRE(ss.str() == "\033[91mab\033[0m");
+}
+
+#ifndef _WIN32
+TEST_CASE("StyledText should downgrade colours when writing to an fd", "[StyledText]") {
+    StyledText text;
+    text.append("a", foreground(255, 0, 0)).append("b", foreground(196));
+
+    int fds[2];
+    REQUIRE(pipe(fds) == 0);
+    auto readAll = [&]() {
+        std::string out(64, '\0');
+        auto bytes = read(fds[0], out.data(), out.size());
+        REQUIRE(bytes >= 0);
+        out.resize(static_cast<size_t>(bytes));
+        return out;
+    };
+
+    text.writeTo(fds[1], ColourDepth::FOUR_BIT);
+    REQUIRE(readAll() == "\033[91mab\033[0m");
+
+    // The terminal depth comes from the environment, so just make sure it's the one that's used
+    text.writeTo(fds[1], true);
+    REQUIRE(readAll() == text.render(getTerminalColourDepth()));
+    text.writeTo(fds[1], false);
+    REQUIRE(readAll() == "ab");
+
+    close(fds[0]);
+    close(fds[1]);
+}
+#endif
@@ -5,3 +5,5 @@
 #else
 #define ECHO_CMD "./bin/pseudoecho.exe"
 #endif
+
+#define SHARED_BUFFER_CAT_CMD "./bin/sharedbuffercat"
@@ -0,0 +1,17 @@
+#include <stc/unix/SharedRingBuffer.hpp>
+#include <unistd.h>
+
+// Counterpart to the SharedRingBuffer tests; writes everything in the buffer passed through STC_TEST_BUFFER to stdout
+int main() {
+    auto buffer = stc::Unix::SharedRingBuffer::fromEnv("STC_TEST_BUFFER");
+    while (true) {
+        auto data = buffer->peek();
+        if (data.empty()) {
+            break;
+        }
+        if (write(STDOUT_FILENO, data.data(), data.size()) != (ssize_t) data.size()) {
+            return 1;
+        }
+        buffer->consume(data.size());
+    }
+}
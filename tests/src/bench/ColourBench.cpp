@@ -0,0 +1,76 @@
+#include "stc/Colour.hpp"
+#include <catch2/catch_test_macros.hpp>
+#include <catch2/benchmark/catch_benchmark.hpp>
+#include <sstream>
+
+namespace legacy {
+
+// Copies of the manipulators from before the escape sequences were generated at compile time, kept around as a
+// baseline. Note that eightBit is left as it was, i.e. printing the code as a raw char.
+template <stc::colour::FourBitColour Colour>
+std::ostream& fg(std::ostream& stream) {
+    if (stc::colour::_detail::shouldPrintColour(stream)) {
+        stream << "\033[" << static_cast<int>(Colour) << "m";
+    }
+    return stream;
+}
+
+template <uint8_t code>
+std::ostream& fg(std::ostream& stream) {
+    if (stc::colour::_detail::shouldPrintColour(stream)) {
+        stream << "\033[" << stc::colour::_detail::FOREGROUND << ";5;" << code << "m";
+    }
+    return stream;
+}
+
+inline std::ostream& reset(std::ostream& stream) {
+    if (stc::colour::_detail::shouldPrintColour(stream)) {
+        stream << "\033[0m";
+    }
+    return stream;
+}
+
+}
+
+TEST_CASE("Colour benchmark", "[benchmark]") {
+    std::stringstream ss;
+    ss << stc::colour::force;
+
+    BENCHMARK("Legacy manipulators") {
+        ss.str("");
+        for (int i = 0; i < 100; ++i) {
+            ss << legacy::fg<stc::colour::FourBitColour::RED> << "error"
+                << legacy::fg<240> << " | "
+                << legacy::reset << "message\n";
+        }
+        return ss.tellp();
+    };
+    BENCHMARK("Compile-time manipulators") {
+        ss.str("");
+        for (int i = 0; i < 100; ++i) {
+            ss << stc::colour::fg<stc::colour::FourBitColour::RED> << "error"
+                << stc::colour::fg<240> << " | "
+                << stc::colour::reset << "message\n";
+        }
+        return ss.tellp();
+    };
+    BENCHMARK("Runtime styles") {
+        auto error = stc::colour::Style::of(stc::colour::foreground(stc::colour::FourBitColour::RED));
+        auto separator = stc::colour::Style::of(stc::colour::foreground(240));
+        ss.str("");
+        for (int i = 0; i < 100; ++i) {
+            ss << error << "error"
+                << separator << " | "
+                << stc::colour::reset << "message\n";
+        }
+        return ss.tellp();
+    };
+    BENCHMARK("Runtime truecolour styles") {
+        auto style = stc::colour::Style::of(stc::colour::foreground(255, 0, 42), stc::colour::background(1, 20, 100));
+        ss.str("");
+        for (int i = 0; i < 100; ++i) {
+            ss << style << "error" << stc::colour::reset << "message\n";
+        }
+        return ss.tellp();
+    };
+}
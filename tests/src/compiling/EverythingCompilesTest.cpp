@@ -1,6 +1,10 @@
+#include <stc/AnsiParser.hpp>
 #include <stc/Colour.hpp>
+#include <stc/EnvSnapshot.hpp>
 #include <stc/Environment.hpp>
 #include <stc/FileLock.hpp>
+#include <stc/FileUtil.hpp>
 #include <stc/IO.hpp>
 #include <stc/StdFix.hpp>
 #include <stc/StringUtil.hpp>
+#include <stc/StyledText.hpp>
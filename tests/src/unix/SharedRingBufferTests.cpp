@@ -0,0 +1,125 @@
+#ifdef __linux__
+
+#include "_meta/Constants.hpp"
+#include <catch2/catch_test_macros.hpp>
+#include <cstring>
+#include <stc/test/TestEnvVariable.hpp>
+#include <stc/unix/Process.hpp>
+#include <stc/unix/SharedRingBuffer.hpp>
+#include <string>
+#include <thread>
+#include <unistd.h>
+
+TEST_CASE("SharedRingBuffer capacity should be rounded to pages", "[SharedRingBuffer]") {
+    stc::Unix::SharedRingBuffer buffer(1);
+    REQUIRE(buffer.getCapacity() == (size_t) sysconf(_SC_PAGESIZE));
+    REQUIRE(buffer.available() == 0);
+    REQUIRE_THROWS(buffer.reserve(buffer.getCapacity() + 1));
+}
+
+TEST_CASE("SharedRingBuffer ranges should be contiguous across the wrap point", "[SharedRingBuffer]") {
+    stc::Unix::SharedRingBuffer buffer(1);
+    auto capacity = buffer.getCapacity();
+
+    // Move the head and tail close to the end of the buffer
+    buffer.write(std::string(capacity - 3, 'x'));
+    buffer.consume(buffer.peek().size());
+
+    buffer.write("trans rights");
+    auto span = buffer.peek();
+    REQUIRE(std::string(span.begin(), span.end()) == "trans rights");
+    buffer.consume(span.size());
+    REQUIRE(buffer.available() == 0);
+}
+
+TEST_CASE("SharedRingBuffer should be attachable through its fd", "[SharedRingBuffer]") {
+    auto buffer = stc::Unix::createSharedRingBuffer(4096);
+    auto attached = stc::Unix::SharedRingBuffer::fromFd(dup(buffer->getFd()));
+
+    buffer->write("owo");
+    buffer->closeWrite();
+    REQUIRE(attached->readAll() == "owo");
+    REQUIRE(attached->isEOF());
+    REQUIRE(buffer->isEOF());
+}
+
+TEST_CASE("SharedRingBuffer should not accept arbitrary fds", "[SharedRingBuffer]") {
+    REQUIRE_THROWS(stc::Unix::SharedRingBuffer::fromFd(dup(STDIN_FILENO)));
+}
+
+TEST_CASE("SharedRingBuffer should reject malformed fds in the environment", "[SharedRingBuffer]") {
+    REQUIRE_THROWS_AS(stc::Unix::SharedRingBuffer::fromEnv("STC_TEST_RING_UNDEFINED"), std::runtime_error);
+    for (const auto& value : { "owo", "3x", "-1", "99999999999999999999" }) {
+        stc::testutil::TestEnvVariable var("STC_TEST_RING_FD", value);
+        INFO(value);
+        REQUIRE_THROWS_AS(stc::Unix::SharedRingBuffer::fromEnv("STC_TEST_RING_FD"), std::runtime_error);
+    }
+}
+
+TEST_CASE("SharedRingBuffer should block and wake across threads", "[SharedRingBuffer]") {
+    auto buffer = stc::Unix::createSharedRingBuffer(4096);
+    std::string expected;
+    for (int i = 0; i < 100000; ++i) {
+        expected += std::to_string(i);
+    }
+
+    std::thread producer([&]() {
+        // Odd chunk sizes so the wrap point moves around
+        for (size_t i = 0; i < expected.size(); i += 777) {
+            buffer->write(std::string_view(expected).substr(i, 777));
+        }
+        buffer->closeWrite();
+    });
+    auto result = buffer->readAll();
+    producer.join();
+
+    REQUIRE(result.size() == expected.size());
+    REQUIRE(result == expected);
+}
+
+TEST_CASE("SharedRingBuffer should time out", "[SharedRingBuffer]") {
+    stc::Unix::SharedRingBuffer buffer(1);
+    REQUIRE(buffer.peek(std::chrono::milliseconds(10)).empty());
+    REQUIRE_FALSE(buffer.isEOF());
+
+    buffer.write(std::string(buffer.getCapacity(), 'x'));
+    REQUIRE(buffer.reserve(1, std::chrono::milliseconds(10)).empty());
+}
+
+TEST_CASE("Process should pass shared buffers to the child", "[SharedRingBuffer][Process]") {
+    auto buffer = stc::Unix::createSharedRingBuffer(4096);
+    std::string expected;
+    for (int i = 0; i < 10000; ++i) {
+        expected += std::to_string(i);
+    }
+
+    SECTION("Extending environ") {
+        stc::Unix::Process p({
+            SHARED_BUFFER_CAT_CMD
+        }, stc::Unix::Pipes::separate(false), stc::Unix::Environment {
+            .sharedBuffers = {{"STC_TEST_BUFFER", buffer}}
+        });
+        buffer->write(expected);
+        buffer->closeWrite();
+
+        REQUIRE(p.block() == 0);
+        REQUIRE(p.getStderrBuffer() == "");
+        REQUIRE(p.getStdoutBuffer() == expected);
+    }
+    SECTION("Without environ") {
+        stc::Unix::Process p({
+            SHARED_BUFFER_CAT_CMD
+        }, stc::Unix::Pipes::separate(false), stc::Unix::Environment {
+            .extendEnviron = false,
+            .sharedBuffers = {{"STC_TEST_BUFFER", buffer}}
+        });
+        buffer->write(expected);
+        buffer->closeWrite();
+
+        REQUIRE(p.block() == 0);
+        REQUIRE(p.getStderrBuffer() == "");
+        REQUIRE(p.getStdoutBuffer() == expected);
+    }
+}
+
+#endif
@@ -1,16 +1,21 @@
 #if !defined(_WIN32) && !defined(__APPLE__)
 
 #include "_meta/Constants.hpp"
+#include "stc/test/TestDirectory.hpp"
 #include "stc/test/TestEnvVariable.hpp"
 #include "stc/test/TestFile.hpp"
+#include <algorithm>
 #include <catch2/catch_test_macros.hpp>
+#include <cerrno>
 #include <cstdio>
 #include <filesystem>
 #include <format>
 #include <fstream>
+#include <iterator>
 #include <stc/StringUtil.hpp>
 #include <stc/test/CaptureStream.hpp>
 #include <stc/unix/Process.hpp>
+#include <sys/resource.h>
 #include "stc/StdFix.hpp"
 
 using namespace std::literals;
@@ -446,4 +451,459 @@ TEST_CASE("fd redirects should work") {
     }
 }
 
+TEST_CASE("Process should look up bare commands in PATH", "[Process][PathCache]") {
+    SECTION("Bare commands") {
+        stc::Unix::Process p({
+            "bash", "-c", "exit 69"
+        });
+        REQUIRE(p.block() == 69);
+    }
+    SECTION("Non-existent commands should throw") {
+        REQUIRE_THROWS(
+            stc::Unix::Process({
+                "gjfdhfdhjfdhjfdhjgkfdjkfghhgjkfdurjkfdj"
+            })
+        );
+    }
+}
+
+TEST_CASE("PathCache should be invalidated by directory changes", "[Process][PathCache]") {
+    stc::testutil::TestDirectory dir("/tmp/stc-path-cache-test", true);
+    auto path = dir.folder.string();
+
+    auto& cache = stc::Unix::PathCache::getInstance();
+    REQUIRE_FALSE(cache.resolve("stc-path-cache-cmd", path).has_value());
+
+    auto script = dir.folder / "stc-path-cache-cmd";
+    {
+        std::ofstream f(script);
+        f << "#!/bin/sh\necho owo\n";
+    }
+
+    INFO("Non-executable files should not be resolved");
+    REQUIRE_FALSE(cache.resolve("stc-path-cache-cmd", path).has_value());
+
+    std::filesystem::permissions(
+        script,
+        std::filesystem::perms::owner_exec,
+        std::filesystem::perm_options::add
+    );
+    // Permission changes don't touch the directory mtime, so this has to be invalidated manually
+    cache.invalidate();
+    auto resolved = cache.resolve("stc-path-cache-cmd", path);
+    REQUIRE(resolved.has_value());
+    REQUIRE(*resolved == script);
+
+    stc::Unix::Process p({
+        "stc-path-cache-cmd"
+    }, stc::Unix::Pipes::separate(false), stc::Unix::Environment {
+        .env = {{"PATH", path}}
+    });
+    REQUIRE(p.block() == 0);
+    REQUIRE(p.getStdoutBuffer() == "owo\n");
+
+    std::filesystem::remove(script);
+    REQUIRE_FALSE(cache.resolve("stc-path-cache-cmd", path).has_value());
+}
+
+TEST_CASE("Scheduling options should be applied to the child", "[Process]") {
+    SECTION("Niceness") {
+        // Lowering the niceness needs privileges (or RLIMIT_NICE), but raising it never does, so the target can't be
+        // below whatever the test runs at
+        errno = 0;
+        int current = getpriority(PRIO_PROCESS, 0);
+        REQUIRE(errno == 0);
+        int target = std::max(current, 7);
+
+        stc::Unix::Process p({
+            "nice"
+        }, stc::Unix::Pipes::separate(false), stc::Unix::Environment {
+            .niceness = target
+        });
+        REQUIRE(p.block() == 0);
+        REQUIRE(p.getStdoutBuffer() == std::to_string(target) + "\n");
+    }
+    SECTION("CPU affinity") {
+        stc::Unix::Process p({
+            "grep", "Cpus_allowed_list", "/proc/self/status"
+        }, stc::Unix::Pipes::separate(false), stc::Unix::Environment {
+            .cpuAffinity = std::vector { 0 }
+        });
+        REQUIRE(p.block() == 0);
+        REQUIRE(p.getStdoutBuffer() == "Cpus_allowed_list:\t0\n");
+    }
+    SECTION("Scheduling policy") {
+        // Field 41 is the scheduling policy, and SCHED_IDLE == 5
+        stc::Unix::Process p({
+            "awk", "{ print $41 }", "/proc/self/stat"
+        }, stc::Unix::Pipes::separate(false), stc::Unix::Environment {
+            .schedulingPolicy = stc::Unix::SchedulingPolicy::IDLE
+        });
+        REQUIRE(p.block() == 0);
+        REQUIRE(p.getStdoutBuffer() == "5\n");
+    }
+    SECTION("I/O priority") {
+        stc::Unix::Process p({
+            "bash", "-c", "ionice -p $$"
+        }, stc::Unix::Pipes::separate(false), stc::Unix::Environment {
+            .ioPriority = stc::Unix::IOPriority {
+                stc::Unix::IOPriorityClass::BEST_EFFORT,
+                6
+            }
+        });
+        REQUIRE(p.block() == 0);
+        REQUIRE(p.getStdoutBuffer() == "best-effort: prio 6\n");
+    }
+    SECTION("Invalid values should throw") {
+        // These are rejected by Environment::validate() before forking, so they don't depend on what the test
+        // environment permits
+        REQUIRE_THROWS(
+            stc::Unix::Process({
+                "nice"
+            }, stc::Unix::Environment {
+                .niceness = 69
+            })
+        );
+        REQUIRE_THROWS(
+            stc::Unix::Process({
+                "nice"
+            }, stc::Unix::Environment {
+                .cpuAffinity = std::vector<int> {}
+            })
+        );
+    }
+}
+
+TEST_CASE("PTY options should be respected", "[Process][PTY]") {
+    SECTION("Default mode converts newlines") {
+        stc::Unix::Process p({
+            "printf", "a\\nb\\n"
+        }, stc::Unix::createPTY());
+        REQUIRE(p.block() == 0);
+        REQUIRE(p.getStdoutBuffer() == "a\r\nb\r\n");
+    }
+    SECTION("Raw mode passes output through unmodified") {
+        stc::Unix::Process p({
+            "printf", "a\\nb\\n"
+        }, stc::Unix::createPTY({ .raw = true }));
+        REQUIRE(p.block() == 0);
+        REQUIRE(p.getStdoutBuffer() == "a\nb\n");
+    }
+    SECTION("Echo can be disabled") {
+        stc::Unix::Process p({
+            "head", "-n", "1"
+        }, stc::Unix::createPTY({ .echo = false }));
+        p.writeToStdin("owo\n");
+        REQUIRE(p.block() == 0);
+        REQUIRE(p.getStdoutBuffer() == "owo\r\n");
+    }
+    SECTION("Initial window size") {
+        stc::Unix::Process p({
+            "stty", "size"
+        }, stc::Unix::createPTY({
+            .raw = true,
+            .windowSize = winsize { .ws_row = 42, .ws_col = 69, .ws_xpixel = 0, .ws_ypixel = 0 }
+        }));
+        REQUIRE(p.block() == 0);
+        REQUIRE(p.getStdoutBuffer() == "42 69\n");
+    }
+}
+
+TEST_CASE("Process::resize should notify the child", "[Process][PTY]") {
+    stc::Unix::Process p({
+        "bash", "-c", "trap 'stty size; exit 0' WINCH; echo ready; while true; do sleep 0.05; done"
+    }, stc::Unix::createPTY({ .raw = true }));
+
+    auto start = std::chrono::steady_clock::now();
+    while (p.getStdoutBuffer().find("ready") == std::string::npos) {
+        REQUIRE(std::chrono::steady_clock::now() - start < std::chrono::seconds(10));
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    p.resize(12, 34);
+
+    REQUIRE(p.block() == 0);
+    REQUIRE(p.getStdoutBuffer() == "ready\n12 34\n");
+}
+
+TEST_CASE("Process::resize should require a PTY", "[Process][PTY]") {
+    stc::Unix::Process p({
+        "true"
+    }, stc::Unix::Pipes::separate(false));
+    REQUIRE_THROWS(p.resize(12, 34));
+}
+
+TEST_CASE("TeeReadHandler should deliver output to all handlers", "[Process][TeeReadHandler]") {
+    std::string expected;
+    for (int i = 1; i <= 100000; ++i) {
+        expected += std::to_string(i) + "\n";
+    }
+
+    stc::testutil::TestFile f1{"/tmp/stc-tee-test-1.txt", true};
+    stc::testutil::TestFile f2{"/tmp/stc-tee-test-2.txt", true};
+    auto openFile = [](const stc::testutil::TestFile& f) {
+        return std::shared_ptr<int>(
+            new int(open(f.file.c_str(), O_WRONLY | O_TRUNC)),
+            [](int* fd) {
+                if (*fd >= 0) {
+                    close(*fd);
+                }
+                delete fd;
+            }
+        );
+    };
+    auto readFile = [](const stc::testutil::TestFile& f) {
+        std::ifstream fs(f.file);
+        std::stringstream ss;
+        ss << fs.rdbuf();
+        return ss.str();
+    };
+    auto fd1 = openFile(f1);
+    auto fd2 = openFile(f2);
+    REQUIRE(*fd1 >= 0);
+    REQUIRE(*fd2 >= 0);
+
+    SECTION("Memory and line callbacks") {
+        auto memory = std::make_shared<stc::Unix::InMemoryReadHandler>();
+        size_t lines = 0;
+        std::string last;
+        auto callback = std::make_shared<stc::Unix::LineCallbackReadHandler>([&](std::string_view line) {
+            ++lines;
+            last = line;
+        });
+
+        stc::Unix::Process p(
+            { "seq", "1", "100000" },
+            stc::Unix::Pipes::separate(false),
+            std::nullopt,
+            {},
+            stc::Unix::ReadHandlers {
+                std::make_shared<stc::Unix::TeeReadHandler>(
+                    std::vector<std::shared_ptr<stc::Unix::ReadHandler>> { memory, callback }
+                ),
+                nullptr
+            }
+        );
+        REQUIRE(p.block() == 0);
+        REQUIRE(memory->getStream() == expected);
+        REQUIRE(lines == 100000);
+        REQUIRE(last == "100000");
+    }
+    SECTION("Memory and files") {
+        auto memory = std::make_shared<stc::Unix::InMemoryReadHandler>();
+        stc::Unix::Process p(
+            { "seq", "1", "100000" },
+            stc::Unix::Pipes::separate(false),
+            std::nullopt,
+            {},
+            stc::Unix::ReadHandlers {
+                std::make_shared<stc::Unix::TeeReadHandler>(
+                    std::vector<std::shared_ptr<stc::Unix::ReadHandler>> {
+                        memory,
+                        std::make_shared<stc::Unix::FdRedirectInputHandler>(*fd1),
+                        std::make_shared<stc::Unix::FdRedirectInputHandler>(*fd2),
+                    }
+                ),
+                nullptr
+            }
+        );
+        REQUIRE(p.block() == 0);
+        REQUIRE(memory->getStream() == expected);
+        REQUIRE(readFile(f1) == expected);
+        REQUIRE(readFile(f2) == expected);
+    }
+    SECTION("Only files") {
+        stc::Unix::Process p(
+            { "seq", "1", "100000" },
+            stc::Unix::Pipes::separate(false),
+            std::nullopt,
+            {},
+            stc::Unix::ReadHandlers {
+                std::make_shared<stc::Unix::TeeReadHandler>(
+                    std::vector<std::shared_ptr<stc::Unix::ReadHandler>> {
+                        std::make_shared<stc::Unix::FdRedirectInputHandler>(*fd1),
+                        std::make_shared<stc::Unix::FdRedirectInputHandler>(*fd2),
+                    }
+                ),
+                nullptr
+            }
+        );
+        REQUIRE(p.block() == 0);
+        REQUIRE(readFile(f1) == expected);
+        REQUIRE(readFile(f2) == expected);
+    }
+    SECTION("PTY") {
+        auto memory = std::make_shared<stc::Unix::InMemoryReadHandler>();
+        stc::Unix::Process p(
+            { "seq", "1", "100000" },
+            stc::Unix::createPTY({ .raw = true }),
+            std::nullopt,
+            {},
+            stc::Unix::ReadHandlers {
+                std::make_shared<stc::Unix::TeeReadHandler>(
+                    std::vector<std::shared_ptr<stc::Unix::ReadHandler>> {
+                        memory,
+                        std::make_shared<stc::Unix::FdRedirectInputHandler>(*fd1),
+                    }
+                ),
+                nullptr
+            }
+        );
+        REQUIRE(p.block() == 0);
+        REQUIRE(memory->getStream() == expected);
+        REQUIRE(readFile(f1) == expected);
+    }
+}
+
+TEST_CASE("LineCallbackReadHandler should hold back partial lines until flushed", "[Process][TeeReadHandler]") {
+    std::vector<std::string> lines;
+    stc::Unix::LineCallbackReadHandler handler([&](std::string_view line) {
+        lines.emplace_back(line);
+    });
+    handler.consume("a\nb");
+    handler.consume("c\n\nd");
+    REQUIRE(lines == std::vector<std::string> { "a", "bc", "" });
+    handler.flush();
+    REQUIRE(lines == std::vector<std::string> { "a", "bc", "", "d" });
+}
+
+static_assert(std::input_iterator<stc::Unix::OutputTimeline::Iterator>);
+
+TEST_CASE("OutputTimeline should preserve the order of stdout and stderr", "[Process][OutputTimeline]") {
+    auto timeline = std::make_shared<stc::Unix::OutputTimeline>();
+    stc::Unix::Process p(
+        { "bash", "-c", "echo out1; sleep 0.2; echo err1 >&2; sleep 0.2; printf 'out\\t2\\n'" },
+        stc::Unix::Pipes::separate(true),
+        std::nullopt,
+        {},
+        stc::Unix::ReadHandlers::timeline(timeline)
+    );
+    REQUIRE(p.block() == 0);
+
+    std::vector<stc::Unix::OutputTimeline::Entry> entries(timeline->begin(), timeline->end());
+    REQUIRE(entries.size() == 3);
+    REQUIRE(entries.at(0).stream == stc::Unix::OutputStream::STDOUT);
+    REQUIRE(entries.at(0).data == "out1\n");
+    REQUIRE(entries.at(1).stream == stc::Unix::OutputStream::STDERR);
+    REQUIRE(entries.at(1).data == "err1\n");
+    REQUIRE(entries.at(2).stream == stc::Unix::OutputStream::STDOUT);
+    REQUIRE(entries.at(2).data == "out\t2\n");
+
+    REQUIRE(entries.at(1).timestamp - entries.at(0).timestamp >= 100ms);
+    REQUIRE(entries.at(2).timestamp - entries.at(1).timestamp >= 100ms);
+
+    REQUIRE(timeline->getStream(stc::Unix::OutputStream::STDOUT) == "out1\nout\t2\n");
+    REQUIRE(timeline->getStream(stc::Unix::OutputStream::STDERR) == "err1\n");
+
+    std::stringstream ss;
+    timeline->exportTimeline(ss);
+    auto lines = stc::string::split(ss.str(), '\n');
+    REQUIRE(lines.size() == 4);
+    REQUIRE(lines.at(0).ends_with("\tstdout\tout1\\n"));
+    REQUIRE(lines.at(1).ends_with("\tstderr\terr1\\n"));
+    REQUIRE(lines.at(2).ends_with("\tstdout\tout\\t2\\n"));
+    REQUIRE(lines.at(3) == "");
+}
+
+TEST_CASE("OutputTimeline should record alternating output in order", "[Process][OutputTimeline]") {
+    constexpr size_t rounds = 300;
+    auto timeline = std::make_shared<stc::Unix::OutputTimeline>();
+    // Each round writes to stdout and then immediately to stderr, so both pipes are frequently ready at the same time.
+    // The child then waits for a line on stdin, so rounds can't pile up in the pipes, without relying on sleeps to
+    // space the output out
+    stc::Unix::Process p(
+        {
+            "bash", "-c",
+            std::format("for i in $(seq 0 {}); do echo \"out $i\"; echo \"err $i\" >&2; read -r; done", rounds - 1)
+        },
+        stc::Unix::Pipes::separate(true),
+        std::nullopt,
+        {},
+        stc::Unix::ReadHandlers::timeline(timeline)
+    );
+
+    for (size_t i = 0; i < rounds; ++i) {
+        auto deadline = std::chrono::steady_clock::now() + 10s;
+        while (timeline->size() < (i + 1) * 2 && std::chrono::steady_clock::now() < deadline) {
+            std::this_thread::yield();
+        }
+        REQUIRE(timeline->size() == (i + 1) * 2);
+        p.writeToStdin("\n");
+    }
+    REQUIRE(p.block() == 0);
+
+    size_t i = 0;
+    for (const auto& entry : *timeline) {
+        INFO(i);
+        if (i % 2 == 0) {
+            REQUIRE(entry.stream == stc::Unix::OutputStream::STDOUT);
+            REQUIRE(entry.data == std::format("out {}\n", i / 2));
+        } else {
+            REQUIRE(entry.stream == stc::Unix::OutputStream::STDERR);
+            REQUIRE(entry.data == std::format("err {}\n", i / 2));
+        }
+        ++i;
+    }
+    REQUIRE(i == rounds * 2);
+}
+
+TEST_CASE("AnsiStripReadHandler should strip escapes from PTY output", "[Process][AnsiParser]") {
+    auto memory = std::make_shared<stc::Unix::InMemoryReadHandler>();
+    stc::Unix::Process p(
+        { "printf", "\\033[1;31mred\\033[0m \\033]0;title\\007plain" },
+        stc::Unix::createPTY({ .raw = true }),
+        std::nullopt,
+        {},
+        stc::Unix::ReadHandlers {
+            std::make_shared<stc::Unix::AnsiStripReadHandler>(memory),
+            nullptr
+        }
+    );
+    REQUIRE(p.block() == 0);
+    REQUIRE(memory->getStream() == "red plain");
+}
+
+TEST_CASE("Syscommand should skip the shell when possible", "[Process][syscommand]") {
+    int exitCode = -1;
+    auto mode = stc::Unix::ShellMode::WHEN_NEEDED;
+
+    SECTION("Direct execution") {
+        // syscommandDirect() returns std::nullopt if the command has to go through the shell, so calling it directly
+        // makes sure these actually skip it
+        auto res = stc::Unix::_detail::syscommandDirect(ECHO_CMD " 'hello world' a\\ b '$c'", &exitCode);
+        REQUIRE(res.has_value());
+        REQUIRE(exitCode == 0);
+        REQUIRE(*res == "Argument: " ECHO_CMD "\nArgument: hello world\nArgument: a b\nArgument: $c\n");
+
+        // Larger than the read buffer
+        res = stc::Unix::_detail::syscommandDirect("head -c 200000 /dev/zero", &exitCode);
+        REQUIRE(res.has_value());
+        REQUIRE(exitCode == 0);
+        REQUIRE(*res == std::string(200000, '\0'));
+
+        REQUIRE(stc::Unix::syscommand(ECHO_CMD " 'a|b' \\$c", &exitCode, mode)
+            == "Argument: " ECHO_CMD "\nArgument: a|b\nArgument: $c\n");
+        REQUIRE(exitCode == 0);
+    }
+    SECTION("Return codes") {
+        REQUIRE(stc::Unix::syscommand("false", &exitCode, mode) == "");
+        REQUIRE(exitCode == 1);
+        REQUIRE(stc::Unix::syscommand("exit 69", &exitCode, mode) == "");
+        REQUIRE(exitCode == 69);
+        REQUIRE(stc::Unix::syscommand("gjdjgsdjgkfdsjkglfdjkglsfdjklgø", &exitCode, mode) == "");
+        REQUIRE(exitCode == 127);
+    }
+    SECTION("Shell fallback") {
+        // $HOME is in double quotes, so the shell has to expand it
+        REQUIRE_FALSE(stc::Unix::_detail::syscommandDirect(ECHO_CMD " \"$HOME\"", &exitCode).has_value());
+        auto res = stc::Unix::syscommand(ECHO_CMD " 'hello world' \"$HOME\"", &exitCode, mode);
+        REQUIRE(exitCode == 0);
+        REQUIRE(res.find("Argument: hello world\n") != std::string::npos);
+        REQUIRE(res.find("$HOME") == std::string::npos);
+
+        REQUIRE(stc::Unix::syscommand("echo a | tr a b", &exitCode, mode) == "b\n");
+        REQUIRE(exitCode == 0);
+        REQUIRE(stc::Unix::syscommand("FOO=bar sh -c 'echo $FOO'", &exitCode, mode) == "bar\n");
+    }
+}
+
 #endif
@@ -0,0 +1,85 @@
+#if !defined(_WIN32) && !defined(__APPLE__)
+
+#include <catch2/catch_test_macros.hpp>
+#include <stc/unix/WorkerPool.hpp>
+#include <string>
+#include <thread>
+#include <vector>
+
+TEST_CASE("WorkerPool should dispatch newline-framed requests", "[WorkerPool]") {
+    stc::Unix::WorkerPool pool({
+        "bash", "-c", "while IFS= read -r line; do echo \"re: $line\"; done"
+    }, 2);
+    REQUIRE(pool.size() == 2);
+
+    for (int i = 0; i < 20; ++i) {
+        REQUIRE(pool.submit(std::format("request {}", i)) == std::format("re: request {}", i));
+    }
+    REQUIRE(pool.getRestartCount() == 0);
+    REQUIRE_THROWS(pool.submit("multi\nline"));
+}
+
+TEST_CASE("WorkerPool should dispatch length-prefixed requests", "[WorkerPool]") {
+    stc::Unix::WorkerPool pool({
+        "cat"
+    }, 1, {
+        .framing = stc::Unix::FramingMode::LENGTH_PREFIXED
+    });
+
+    std::string binary("with\nnewlines\0and nulls", 23);
+    REQUIRE(pool.submit(binary) == binary);
+    REQUIRE(pool.submit("") == "");
+
+    std::string large(100000, 'x');
+    REQUIRE(pool.submit(large) == large);
+}
+
+TEST_CASE("WorkerPool should be usable from several threads", "[WorkerPool]") {
+    stc::Unix::WorkerPool pool({
+        "cat"
+    }, 3);
+
+    std::vector<std::thread> threads;
+    std::atomic<int> failures = 0;
+    for (int t = 0; t < 4; ++t) {
+        threads.emplace_back([&, t]() {
+            for (int i = 0; i < 25; ++i) {
+                auto request = std::format("{}-{}", t, i);
+                if (pool.submit(request) != request) {
+                    failures++;
+                }
+            }
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    REQUIRE(failures == 0);
+}
+
+TEST_CASE("WorkerPool should replace crashed workers", "[WorkerPool]") {
+    stc::Unix::WorkerPool pool({
+        "bash", "-c", "while IFS= read -r line; do if [ \"$line\" = crash ]; then exit 1; fi; echo \"$line\"; done"
+    }, 1);
+
+    REQUIRE(pool.submit("owo") == "owo");
+    REQUIRE_THROWS(pool.submit("crash"));
+    REQUIRE(pool.getRestartCount() == 1);
+    REQUIRE(pool.submit("still alive") == "still alive");
+}
+
+TEST_CASE("WorkerPool should enforce timeouts", "[WorkerPool]") {
+    stc::Unix::WorkerPool pool({
+        "bash", "-c", "while IFS= read -r line; do if [ \"$line\" = slow ]; then sleep 10; fi; echo \"$line\"; done"
+    }, 1);
+
+    auto start = std::chrono::steady_clock::now();
+    REQUIRE_THROWS(pool.submit("slow", std::chrono::milliseconds(200)));
+    REQUIRE(std::chrono::steady_clock::now() - start < std::chrono::seconds(5));
+    REQUIRE(pool.getRestartCount() == 1);
+
+    INFO("The replacement worker must not return the response to the timed out request");
+    REQUIRE(pool.submit("fast") == "fast");
+}
+
+#endif